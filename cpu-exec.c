@@ -27,6 +27,7 @@
 #include "qemu/timer.h"
 #include "exec/address-spaces.h"
 #include "qemu/rcu.h"
+#include "qemu/main-loop.h"
 #include "exec/tb-hash.h"
 #include "exec/log.h"
 #if defined(TARGET_I386) && !defined(CONFIG_USER_ONLY)
@@ -227,31 +228,56 @@ static void cpu_exec_nocache(CPUState *cpu, int max_cycles,
 
 static void cpu_exec_step(CPUState *cpu)
 {
+    CPUClass *cc = CPU_GET_CLASS(cpu);
     CPUArchState *env = (CPUArchState *)cpu->env_ptr;
     TranslationBlock *tb;
     target_ulong cs_base, pc;
     uint32_t flags;
 
     cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
-    tb = tb_gen_code(cpu, pc, cs_base, flags,
-                     1 | CF_NOCACHE | CF_IGNORE_ICOUNT);
-    tb->orig_tb = NULL;
-    /* execute the generated code */
-    trace_exec_tb_nocache(tb, pc);
-    cpu_tb_exec(cpu, tb);
-    tb_phys_invalidate(tb, -1);
-    tb_free(tb);
+    if (sigsetjmp(cpu->jmp_env, 0) == 0) {
+        mmap_lock();
+        tb_lock();
+        tb = tb_gen_code(cpu, pc, cs_base, flags,
+                         1 | CF_NOCACHE | CF_IGNORE_ICOUNT);
+        tb->orig_tb = NULL;
+        tb_unlock();
+        mmap_unlock();
+
+        cc->cpu_exec_enter(cpu);
+        /* execute the generated code */
+        trace_exec_tb_nocache(tb, pc);
+        cpu_tb_exec(cpu, tb);
+        cc->cpu_exec_exit(cpu);
+
+        tb_lock();
+        tb_phys_invalidate(tb, -1);
+        tb_free(tb);
+        tb_unlock();
+    } else {
+        /* The instruction faulted; the exception is left pending in
+         * cpu->exception_index for the next cpu_exec().
+         */
+        tb_lock_reset();
+#ifndef CONFIG_USER_ONLY
+        if (qemu_tcg_mttcg_enabled() && qemu_mutex_iothread_locked()) {
+            qemu_mutex_unlock_iothread();
+        }
+#endif
+    }
 }
 
 void cpu_exec_step_atomic(CPUState *cpu)
 {
     start_exclusive();
+    rcu_read_lock();
 
     /* Since we got here, we know that parallel_cpus must be true.  */
     parallel_cpus = false;
     cpu_exec_step(cpu);
     parallel_cpus = true;
 
+    rcu_read_unlock();
     end_exclusive();
 }
 
@@ -290,10 +316,8 @@ static bool tb_cmp(const void *p, const void *d)
     return false;
 }
 
-static TranslationBlock *tb_htable_lookup(CPUState *cpu,
-                                          target_ulong pc,
-                                          target_ulong cs_base,
-                                          uint32_t flags)
+TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
+                                   target_ulong cs_base, uint32_t flags)
 {
     tb_page_addr_t phys_pc;
     struct tb_desc desc;
@@ -330,8 +354,7 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
         if (!tb) {
 
             /* mmap_lock is needed by tb_gen_code, and mmap_lock must be
-             * taken outside tb_lock. As system emulation is currently
-             * single threaded the locks are NOPs.
+             * taken outside tb_lock.  It is a NOP in system emulation.
              */
             mmap_lock();
             tb_lock();
@@ -352,10 +375,15 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
         /* We add the TB in the virtual pc hash table for the fast lookup */
         atomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
     }
-#ifndef CONFIG_USER_ONLY
+    if (!atomic_read(&tb->touched)) {
+        atomic_set(&tb->touched, 1);
+    }
+#if !defined(CONFIG_USER_ONLY) && !defined(TARGET_FIXED_MAPPING)
     /* We don't take care of direct jumps when address mapping changes in
      * system emulation. So it's not safe to make a direct jump to a TB
      * spanning two pages because the mapping for the second page can change.
+     * Targets with a fixed mapping only need to care about the memory map
+     * changing, which tcg_region_del() handles.
      */
     if (tb->page_addr[1] != -1) {
         last_tb = NULL;
@@ -384,8 +412,16 @@ static inline bool cpu_handle_halt(CPUState *cpu)
         if ((cpu->interrupt_request & CPU_INTERRUPT_POLL)
             && replay_interrupt()) {
             X86CPU *x86_cpu = X86_CPU(cpu);
+            bool unlocked = !qemu_mutex_iothread_locked();
+
+            if (unlocked) {
+                qemu_mutex_lock_iothread();
+            }
             apic_poll_irq(x86_cpu->apic_state);
             cpu_reset_interrupt(cpu, CPU_INTERRUPT_POLL);
+            if (unlocked) {
+                qemu_mutex_unlock_iothread();
+            }
         }
 #endif
         if (!cpu_has_work(cpu)) {
@@ -439,7 +475,19 @@ static inline bool cpu_handle_exception(CPUState *cpu, int *ret)
 #else
             if (replay_exception()) {
                 CPUClass *cc = CPU_GET_CLASS(cpu);
+                bool unlocked = !qemu_mutex_iothread_locked();
+
+                /* MTTCG vCPUs run without the BQL, but delivering an
+                 * exception can touch interrupt controllers and other
+                 * vCPUs (e.g. PSCI).
+                 */
+                if (unlocked) {
+                    qemu_mutex_lock_iothread();
+                }
                 cc->do_interrupt(cpu);
+                if (unlocked) {
+                    qemu_mutex_unlock_iothread();
+                }
                 cpu->exception_index = -1;
             } else if (!replay_has_interrupt()) {
                 /* give a chance to iothread in replay mode */
@@ -465,9 +513,19 @@ static inline void cpu_handle_interrupt(CPUState *cpu,
                                         TranslationBlock **last_tb)
 {
     CPUClass *cc = CPU_GET_CLASS(cpu);
-    int interrupt_request = cpu->interrupt_request;
+    int interrupt_request = atomic_read(&cpu->interrupt_request);
 
     if (unlikely(interrupt_request)) {
+        /* Interrupts are raised and acknowledged under the BQL.  If one of
+         * the paths below leaves through cpu_loop_exit() the lock is dropped
+         * in cpu_exec().
+         */
+        bool unlocked = !qemu_mutex_iothread_locked();
+
+        if (unlocked) {
+            qemu_mutex_lock_iothread();
+            interrupt_request = cpu->interrupt_request;
+        }
         if (unlikely(cpu->singlestep_enabled & SSTEP_NOIRQ)) {
             /* Mask out external interrupts for this step. */
             interrupt_request &= ~CPU_INTERRUPT_SSTEP_MASK;
@@ -522,6 +580,9 @@ static inline void cpu_handle_interrupt(CPUState *cpu,
                the program flow was changed */
             *last_tb = NULL;
         }
+        if (unlocked) {
+            qemu_mutex_unlock_iothread();
+        }
     }
     if (unlikely(atomic_read(&cpu->exit_request) || replay_has_interrupt())) {
         atomic_set(&cpu->exit_request, 0);
@@ -655,6 +716,14 @@ int cpu_exec(CPUState *cpu)
 #endif /* buggy compiler */
             cpu->can_do_io = 1;
             tb_lock_reset();
+#ifndef CONFIG_USER_ONLY
+            /* An MTTCG vCPU may have left a helper or the interrupt code
+             * with the BQL held, the round-robin thread always holds it.
+             */
+            if (qemu_tcg_mttcg_enabled() && qemu_mutex_iothread_locked()) {
+                qemu_mutex_unlock_iothread();
+            }
+#endif
         }
     } /* for(;;) */
 
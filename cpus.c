@@ -36,6 +36,8 @@
 #include "sysemu/kvm.h"
 #include "qmp-commands.h"
 #include "exec/exec-all.h"
+#include "tcg.h"
+#include "exec/tb-cache.h"
 
 #include "qemu/thread.h"
 #include "sysemu/cpus.h"
@@ -692,6 +694,46 @@ void configure_icount(QemuOpts *opts, Error **errp)
                    NANOSECONDS_PER_SECOND / 10);
 }
 
+/* -accel tcg,thread=single|multi
+ *
+ * In multi-threaded mode every vCPU gets its own host thread and runs
+ * without the BQL.  Targets opt in by defining TARGET_SUPPORTS_MTTCG once
+ * their helpers take the BQL where they touch device state and their
+ * atomics and barriers are expressed with TCG ops.
+ */
+void qemu_tcg_configure(QemuOpts *opts, Error **errp)
+{
+    const char *t = qemu_opt_get(opts, "thread");
+
+    if (!t || strcmp(t, "single") == 0) {
+        mttcg_enabled = false;
+    } else if (strcmp(t, "multi") == 0) {
+#ifndef TARGET_SUPPORTS_MTTCG
+        error_setg(errp, "This guest does not support multi-threaded TCG");
+        return;
+#else
+        if (TCG_OVERSIZED_GUEST) {
+            error_setg(errp, "No multi-threaded TCG when the guest word size "
+                       "is larger than the host's");
+            return;
+        }
+        if (use_icount) {
+            error_setg(errp, "No multi-threaded TCG when icount is enabled");
+            return;
+        }
+        mttcg_enabled = true;
+#endif
+    } else {
+        error_setg(errp, "Invalid 'thread' setting %s", t);
+        return;
+    }
+
+    t = qemu_opt_get(opts, "tb-cache");
+    if (t) {
+        tb_cache_init(t, errp);
+    }
+}
+
 /***********************************************************/
 void hw_error(const char *fmt, ...)
 {
@@ -958,6 +1000,15 @@ static void qemu_tcg_wait_io_event(CPUState *cpu)
     }
 }
 
+static void qemu_mttcg_wait_io_event(CPUState *cpu)
+{
+    while (cpu_thread_is_idle(cpu)) {
+        qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+    }
+
+    qemu_wait_io_event_common(cpu);
+}
+
 static void qemu_kvm_wait_io_event(CPUState *cpu)
 {
     while (cpu_thread_is_idle(cpu)) {
@@ -1148,7 +1199,13 @@ static void deal_with_unplugged_cpus(void)
     }
 }
 
-static void *qemu_tcg_cpu_thread_fn(void *arg)
+/* Single-threaded TCG
+ *
+ * All vCPUs share one host thread and are run in turn.  The thread holds
+ * the BQL while executing guest code, other threads kick it out of the
+ * loop when they need the lock.
+ */
+static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
 {
     CPUState *cpu = arg;
 
@@ -1220,6 +1277,60 @@ static void *qemu_tcg_cpu_thread_fn(void *arg)
     return NULL;
 }
 
+/* Multi-threaded TCG
+ *
+ * Each vCPU runs on its own host thread, without the BQL.  Code that
+ * needs the lock (MMIO, interrupt delivery, some helpers) takes it, and
+ * other threads reach a vCPU through run_on_cpu and friends, which kick
+ * it out of the execution loop.
+ */
+static void *qemu_tcg_cpu_thread_fn(void *arg)
+{
+    CPUState *cpu = arg;
+
+    rcu_register_thread();
+
+    qemu_mutex_lock_iothread();
+    qemu_thread_get_self(cpu->thread);
+
+    cpu->thread_id = qemu_get_thread_id();
+    cpu->created = true;
+    cpu->can_do_io = 1;
+    current_cpu = cpu;
+    qemu_cond_signal(&qemu_cpu_cond);
+
+    /* process any pending work */
+    cpu->exit_request = 1;
+
+    do {
+        if (cpu_can_run(cpu)) {
+            int r;
+
+            qemu_mutex_unlock_iothread();
+            r = tcg_cpu_exec(cpu);
+            if (r == EXCP_ATOMIC) {
+                /* runs with all other vCPUs stopped */
+                cpu_exec_step_atomic(cpu);
+            }
+            qemu_mutex_lock_iothread();
+            current_cpu = cpu;
+
+            if (r == EXCP_DEBUG) {
+                cpu_handle_guest_debug(cpu);
+            }
+        }
+
+        atomic_mb_set(&cpu->exit_request, 0);
+        qemu_mttcg_wait_io_event(cpu);
+    } while (!cpu->unplug || cpu_can_run(cpu));
+
+    qemu_tcg_destroy_vcpu(cpu);
+    cpu->created = false;
+    qemu_cond_signal(&qemu_cpu_cond);
+    qemu_mutex_unlock_iothread();
+    return NULL;
+}
+
 static void qemu_cpu_kick_thread(CPUState *cpu)
 {
 #ifndef _WIN32
@@ -1256,7 +1367,11 @@ void qemu_cpu_kick(CPUState *cpu)
 {
     qemu_cond_broadcast(cpu->halt_cond);
     if (tcg_enabled()) {
-        qemu_cpu_kick_no_halt();
+        if (qemu_tcg_mttcg_enabled()) {
+            cpu_exit(cpu);
+        } else {
+            qemu_cpu_kick_no_halt();
+        }
     } else {
         qemu_cpu_kick_thread(cpu);
     }
@@ -1289,9 +1404,9 @@ void qemu_mutex_lock_iothread(void)
 {
     atomic_inc(&iothread_requesting_mutex);
     /* In the simple case there is no need to bump the VCPU thread out of
-     * TCG code execution.
+     * TCG code execution.  MTTCG vCPUs never hold the lock while running.
      */
-    if (!tcg_enabled() || qemu_in_vcpu_thread() ||
+    if (!tcg_enabled() || qemu_tcg_mttcg_enabled() || qemu_in_vcpu_thread() ||
         !first_cpu || !first_cpu->created) {
         qemu_mutex_lock(&qemu_global_mutex);
         atomic_dec(&iothread_requesting_mutex);
@@ -1337,7 +1452,8 @@ void pause_all_vcpus(void)
 
     if (qemu_in_vcpu_thread()) {
         cpu_stop_current();
-        if (!kvm_enabled()) {
+        /* with a single TCG thread no other vCPU can be running now */
+        if (!kvm_enabled() && !qemu_tcg_mttcg_enabled()) {
             CPU_FOREACH(cpu) {
                 cpu->stop = false;
                 cpu->stopped = true;
@@ -1395,6 +1511,26 @@ static void qemu_tcg_init_vcpu(CPUState *cpu)
     static QemuCond *tcg_halt_cond;
     static QemuThread *tcg_cpu_thread;
 
+    if (qemu_tcg_mttcg_enabled()) {
+        /* vCPUs now run concurrently, generate real atomic operations */
+        parallel_cpus = true;
+
+        cpu->thread = g_malloc0(sizeof(QemuThread));
+        cpu->halt_cond = g_malloc0(sizeof(QemuCond));
+        qemu_cond_init(cpu->halt_cond);
+        snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/TCG",
+                 cpu->cpu_index);
+        qemu_thread_create(cpu->thread, thread_name, qemu_tcg_cpu_thread_fn,
+                           cpu, QEMU_THREAD_JOINABLE);
+#ifdef _WIN32
+        cpu->hThread = qemu_thread_get_handle(cpu->thread);
+#endif
+        while (!cpu->created) {
+            qemu_cond_wait(&qemu_cpu_cond, &qemu_global_mutex);
+        }
+        return;
+    }
+
     /* share a single thread for all cpus with TCG */
     if (!tcg_cpu_thread) {
         cpu->thread = g_malloc0(sizeof(QemuThread));
@@ -1403,7 +1539,8 @@ static void qemu_tcg_init_vcpu(CPUState *cpu)
         tcg_halt_cond = cpu->halt_cond;
         snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/TCG",
                  cpu->cpu_index);
-        qemu_thread_create(cpu->thread, thread_name, qemu_tcg_cpu_thread_fn,
+        qemu_thread_create(cpu->thread, thread_name,
+                           qemu_tcg_rr_cpu_thread_fn,
                            cpu, QEMU_THREAD_JOINABLE);
 #ifdef _WIN32
         cpu->hThread = qemu_thread_get_handle(cpu->thread);
@@ -31,6 +31,8 @@
 #include "exec/log.h"
 #include "exec/helper-proto.h"
 #include "qemu/atomic.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
 
 /* DEBUG defines, enable DEBUG_TLB_LOG to log to the CPU_LOG_MMU target */
 /* #define DEBUG_TLB */
@@ -60,6 +62,174 @@
 /* statistics */
 int tlb_flush_count;
 
+/* With MTTCG a vCPU only touches its own TLB.  Flushes requested from
+ * another thread are queued as work for the owning vCPU, which kicks it
+ * out of the execution loop so the flush happens before it runs more
+ * guest code.  Until the vCPU thread exists nothing can race with us.
+ */
+static bool tlb_flush_is_async(CPUState *cpu)
+{
+    return qemu_tcg_mttcg_enabled() && cpu->created && !qemu_cpu_is_self(cpu);
+}
+
+/* The mmu_idx bitmap and the page address share one run_on_cpu argument */
+QEMU_BUILD_BUG_ON(NB_MMU_MODES > TARGET_PAGE_BITS_MIN);
+
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* A TLB grows as soon as more than TLB_GROW_RATE percent of it was in use
+ * at a flush.  It shrinks only once it stayed below TLB_SHRINK_RATE percent
+ * for a whole window, so that a burst of flushes (a guest switching
+ * address spaces, say) does not make it oscillate.
+ */
+#define TLB_WINDOW_NS   (100 * SCALE_MS)
+#define TLB_GROW_RATE   70
+#define TLB_SHRINK_RATE 30
+
+static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns, size_t max_entries)
+{
+    desc->window_begin_ns = ns;
+    desc->window_max_entries = max_entries;
+}
+
+/* Allocate the TLB of 'mmu_idx' with 'n_entries' entries, or fewer if
+ * the host is short of memory.  The caller flushes it.
+ */
+static void tlb_mmu_alloc(CPUArchState *env, int mmu_idx, size_t n_entries)
+{
+    CPUTLBEntry *table;
+    CPUIOTLBEntry *iotlb;
+
+    for (;;) {
+        if (n_entries <= 1 << CPU_TLB_DYN_MIN_BITS) {
+            n_entries = 1 << CPU_TLB_DYN_MIN_BITS;
+            table = g_new(CPUTLBEntry, n_entries);
+            iotlb = g_new(CPUIOTLBEntry, n_entries);
+            break;
+        }
+        table = g_try_new(CPUTLBEntry, n_entries);
+        iotlb = g_try_new(CPUIOTLBEntry, n_entries);
+        if (table && iotlb) {
+            break;
+        }
+        g_free(table);
+        g_free(iotlb);
+        n_entries >>= 1;
+    }
+
+    env->tlb_mask[mmu_idx] = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
+    env->tlb_table[mmu_idx] = table;
+    env->iotlb[mmu_idx] = iotlb;
+}
+
+/* Called with tlb_lock held, when the TLB of 'mmu_idx' is flushed.  */
+static void tlb_mmu_resize_locked(CPUArchState *env, int mmu_idx)
+{
+    CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
+    size_t old_size = tlb_n_entries(env, mmu_idx);
+    size_t new_size = old_size;
+    int64_t now = get_clock_realtime();
+    bool window_expired = now > desc->window_begin_ns + TLB_WINDOW_NS;
+    size_t rate;
+
+    if (desc->n_used_entries > desc->window_max_entries) {
+        desc->window_max_entries = desc->n_used_entries;
+    }
+    rate = desc->window_max_entries * 100 / old_size;
+
+    if (rate > TLB_GROW_RATE) {
+        new_size = MIN(old_size << 1, 1 << CPU_TLB_DYN_MAX_BITS);
+    } else if (rate < TLB_SHRINK_RATE && window_expired) {
+        size_t ceil = pow2ceil(desc->window_max_entries);
+        size_t expected_rate = desc->window_max_entries * 100 / ceil;
+
+        /* Do not shrink to a size that would grow again at once.  */
+        if (expected_rate > TLB_GROW_RATE) {
+            ceil *= 2;
+        }
+        new_size = MAX(ceil, 1 << CPU_TLB_DYN_MIN_BITS);
+    }
+
+    if (new_size == old_size) {
+        if (window_expired) {
+            tlb_window_reset(desc, now, desc->n_used_entries);
+        }
+        return;
+    }
+
+    g_free(env->tlb_table[mmu_idx]);
+    g_free(env->iotlb[mmu_idx]);
+    tlb_window_reset(desc, now, 0);
+    tlb_mmu_alloc(env, mmu_idx, new_size);
+}
+#endif
+
+void tlb_init(CPUState *cpu)
+{
+    CPUArchState *env = cpu->env_ptr;
+
+    qemu_spin_init(&env->tlb_lock);
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    {
+        int64_t now = get_clock_realtime();
+        int mmu_idx;
+
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            tlb_window_reset(&env->tlb_d[mmu_idx], now, 0);
+            env->tlb_d[mmu_idx].n_used_entries = 0;
+            tlb_mmu_alloc(env, mmu_idx, 1 << CPU_TLB_DYN_DEFAULT_BITS);
+            memset(env->tlb_table[mmu_idx], -1,
+                   tlb_n_entries(env, mmu_idx) * sizeof(CPUTLBEntry));
+        }
+    }
+#endif
+}
+
+void tlb_destroy(CPUState *cpu)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    CPUArchState *env = cpu->env_ptr;
+    int mmu_idx;
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        g_free(env->tlb_table[mmu_idx]);
+        g_free(env->iotlb[mmu_idx]);
+        env->tlb_table[mmu_idx] = NULL;
+        env->iotlb[mmu_idx] = NULL;
+    }
+#endif
+}
+
+static inline void tlb_n_used_entries_inc(CPUArchState *env, int mmu_idx)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    env->tlb_d[mmu_idx].n_used_entries++;
+#endif
+}
+
+static inline void tlb_n_used_entries_dec(CPUArchState *env, int mmu_idx)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    env->tlb_d[mmu_idx].n_used_entries--;
+#endif
+}
+
+static inline bool tlb_entry_is_empty(const CPUTLBEntry *te)
+{
+    return te->addr_read == -1 && te->addr_write == -1 && te->addr_code == -1;
+}
+
+/* Called with tlb_lock held.  */
+static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    tlb_mmu_resize_locked(env, mmu_idx);
+    env->tlb_d[mmu_idx].n_used_entries = 0;
+#endif
+    memset(env->tlb_table[mmu_idx], -1,
+           tlb_n_entries(env, mmu_idx) * sizeof(CPUTLBEntry));
+    memset(env->tlb_v_table[mmu_idx], -1, sizeof(env->tlb_v_table[0]));
+}
+
 /* NOTE:
  * If flush_global is true (the usual case), flush all tlb entries.
  * If flush_global is false, flush (at least) all tlb entries not
@@ -72,27 +242,43 @@ int tlb_flush_count;
  * entries from the TLB at any time, so flushing more entries than
  * required is only an efficiency issue, not a correctness issue.
  */
-void tlb_flush(CPUState *cpu, int flush_global)
+static void tlb_flush_nocheck(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
+    int mmu_idx;
 
-    tlb_debug("(%d)\n", flush_global);
-
-    memset(env->tlb_table, -1, sizeof(env->tlb_table));
-    memset(env->tlb_v_table, -1, sizeof(env->tlb_v_table));
+    qemu_spin_lock(&env->tlb_lock);
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        tlb_flush_one_mmuidx_locked(env, mmu_idx);
+    }
+    qemu_spin_unlock(&env->tlb_lock);
     memset(cpu->tb_jmp_cache, 0, sizeof(cpu->tb_jmp_cache));
 
     env->vtlb_index = 0;
     env->tlb_flush_addr = -1;
     env->tlb_flush_mask = 0;
-    tlb_flush_count++;
+    atomic_inc(&tlb_flush_count);
 }
 
-static inline void v_tlb_flush_by_mmuidx(CPUState *cpu, va_list argp)
+static void tlb_flush_async_work(CPUState *cpu, run_on_cpu_data data)
 {
-    CPUArchState *env = cpu->env_ptr;
+    tlb_flush_nocheck(cpu);
+}
 
-    tlb_debug("start\n");
+void tlb_flush(CPUState *cpu, int flush_global)
+{
+    tlb_debug("(%d)\n", flush_global);
+
+    if (tlb_flush_is_async(cpu)) {
+        async_run_on_cpu(cpu, tlb_flush_async_work, RUN_ON_CPU_NULL);
+    } else {
+        tlb_flush_nocheck(cpu);
+    }
+}
+
+static uint16_t v_tlb_mmuidx_map(va_list argp)
+{
+    uint16_t idxmap = 0;
 
     for (;;) {
         int mmu_idx = va_arg(argp, int);
@@ -100,25 +286,62 @@ static inline void v_tlb_flush_by_mmuidx(CPUState *cpu, va_list argp)
         if (mmu_idx < 0) {
             break;
         }
+        idxmap |= 1 << mmu_idx;
+    }
+    return idxmap;
+}
+
+static void tlb_flush_by_mmuidx_nocheck(CPUState *cpu, uint16_t idxmap)
+{
+    CPUArchState *env = cpu->env_ptr;
+    int mmu_idx;
+
+    tlb_debug("start\n");
+
+    qemu_spin_lock(&env->tlb_lock);
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        if (!(idxmap & (1 << mmu_idx))) {
+            continue;
+        }
 
         tlb_debug("%d\n", mmu_idx);
 
-        memset(env->tlb_table[mmu_idx], -1, sizeof(env->tlb_table[0]));
-        memset(env->tlb_v_table[mmu_idx], -1, sizeof(env->tlb_v_table[0]));
+        tlb_flush_one_mmuidx_locked(env, mmu_idx);
     }
+    qemu_spin_unlock(&env->tlb_lock);
 
     memset(cpu->tb_jmp_cache, 0, sizeof(cpu->tb_jmp_cache));
 }
 
+static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    tlb_flush_by_mmuidx_nocheck(cpu, data.host_int);
+}
+
+static void tlb_flush_by_idxmap(CPUState *cpu, uint16_t idxmap)
+{
+    if (tlb_flush_is_async(cpu)) {
+        async_run_on_cpu(cpu, tlb_flush_by_mmuidx_async_work,
+                         RUN_ON_CPU_HOST_INT(idxmap));
+    } else {
+        tlb_flush_by_mmuidx_nocheck(cpu, idxmap);
+    }
+}
+
 void tlb_flush_by_mmuidx(CPUState *cpu, ...)
 {
     va_list argp;
+    uint16_t idxmap;
+
     va_start(argp, cpu);
-    v_tlb_flush_by_mmuidx(cpu, argp);
+    idxmap = v_tlb_mmuidx_map(argp);
     va_end(argp);
+
+    tlb_flush_by_idxmap(cpu, idxmap);
 }
 
-static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
+/* Returns true if the entry was for 'addr' and has been flushed.  */
+static inline bool tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
 {
     if (addr == (tlb_entry->addr_read &
                  (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
@@ -127,13 +350,14 @@ static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
         addr == (tlb_entry->addr_code &
                  (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
         memset(tlb_entry, -1, sizeof(*tlb_entry));
+        return true;
     }
+    return false;
 }
 
-void tlb_flush_page(CPUState *cpu, target_ulong addr)
+static void tlb_flush_page_nocheck(CPUState *cpu, target_ulong addr)
 {
     CPUArchState *env = cpu->env_ptr;
-    int i;
     int mmu_idx;
 
     tlb_debug("page :" TARGET_FMT_lx "\n", addr);
@@ -144,14 +368,15 @@ void tlb_flush_page(CPUState *cpu, target_ulong addr)
                   TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
                   env->tlb_flush_addr, env->tlb_flush_mask);
 
-        tlb_flush(cpu, 1);
+        tlb_flush_nocheck(cpu);
         return;
     }
 
     addr &= TARGET_PAGE_MASK;
-    i = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
+        if (tlb_flush_entry(tlb_entry(env, mmu_idx, addr), addr)) {
+            tlb_n_used_entries_dec(env, mmu_idx);
+        }
     }
 
     /* check whether there are entries that need to be flushed in the vtlb */
@@ -165,13 +390,26 @@ void tlb_flush_page(CPUState *cpu, target_ulong addr)
     tb_flush_jmp_cache(cpu, addr);
 }
 
-void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, ...)
+static void tlb_flush_page_async_work(CPUState *cpu, run_on_cpu_data data)
 {
-    CPUArchState *env = cpu->env_ptr;
-    int i, k;
-    va_list argp;
+    tlb_flush_page_nocheck(cpu, data.target_ptr);
+}
 
-    va_start(argp, addr);
+void tlb_flush_page(CPUState *cpu, target_ulong addr)
+{
+    if (tlb_flush_is_async(cpu)) {
+        async_run_on_cpu(cpu, tlb_flush_page_async_work,
+                         RUN_ON_CPU_TARGET_PTR(addr));
+    } else {
+        tlb_flush_page_nocheck(cpu, addr);
+    }
+}
+
+static void tlb_flush_page_by_mmuidx_nocheck(CPUState *cpu, target_ulong addr,
+                                             uint16_t idxmap)
+{
+    CPUArchState *env = cpu->env_ptr;
+    int k, mmu_idx;
 
     tlb_debug("addr "TARGET_FMT_lx"\n", addr);
 
@@ -181,35 +419,158 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, ...)
                   TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
                   env->tlb_flush_addr, env->tlb_flush_mask);
 
-        v_tlb_flush_by_mmuidx(cpu, argp);
-        va_end(argp);
+        tlb_flush_by_mmuidx_nocheck(cpu, idxmap);
         return;
     }
 
     addr &= TARGET_PAGE_MASK;
-    i = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-
-    for (;;) {
-        int mmu_idx = va_arg(argp, int);
 
-        if (mmu_idx < 0) {
-            break;
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        if (!(idxmap & (1 << mmu_idx))) {
+            continue;
         }
 
         tlb_debug("idx %d\n", mmu_idx);
 
-        tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
+        if (tlb_flush_entry(tlb_entry(env, mmu_idx, addr), addr)) {
+            tlb_n_used_entries_dec(env, mmu_idx);
+        }
 
         /* check whether there are vltb entries that need to be flushed */
         for (k = 0; k < CPU_VTLB_SIZE; k++) {
             tlb_flush_entry(&env->tlb_v_table[mmu_idx][k], addr);
         }
     }
-    va_end(argp);
 
     tb_flush_jmp_cache(cpu, addr);
 }
 
+static void tlb_flush_page_by_mmuidx_async_work(CPUState *cpu,
+                                                run_on_cpu_data data)
+{
+    target_ulong addr = data.target_ptr & TARGET_PAGE_MASK;
+    uint16_t idxmap = data.target_ptr & ~TARGET_PAGE_MASK;
+
+    tlb_flush_page_by_mmuidx_nocheck(cpu, addr, idxmap);
+}
+
+void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, ...)
+{
+    va_list argp;
+    uint16_t idxmap;
+
+    va_start(argp, addr);
+    idxmap = v_tlb_mmuidx_map(argp);
+    va_end(argp);
+
+    if (tlb_flush_is_async(cpu)) {
+        addr = (addr & TARGET_PAGE_MASK) | idxmap;
+        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_work,
+                         RUN_ON_CPU_TARGET_PTR(addr));
+    } else {
+        tlb_flush_page_by_mmuidx_nocheck(cpu, addr, idxmap);
+    }
+}
+
+/* Broadcast flushes, as done by TLB maintenance instructions that must
+ * have completed on every vCPU before the issuing one continues.  With
+ * MTTCG the flush is queued as safe work on the source vCPU: it runs
+ * while all vCPUs are outside their execution loops, so every TLB can be
+ * flushed from here, and the source only resumes afterwards.  The caller
+ * must end the TB so that the source vCPU leaves its loop right away.
+ */
+static void tlb_flush_all_cpus_work(CPUState *src_cpu, run_on_cpu_data data)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        tlb_flush_nocheck(cpu);
+    }
+}
+
+static void tlb_flush_by_mmuidx_all_cpus_work(CPUState *src_cpu,
+                                              run_on_cpu_data data)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        tlb_flush_by_mmuidx_nocheck(cpu, data.host_int);
+    }
+}
+
+static void tlb_flush_page_all_cpus_work(CPUState *src_cpu,
+                                         run_on_cpu_data data)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        tlb_flush_page_nocheck(cpu, data.target_ptr);
+    }
+}
+
+static void tlb_flush_page_by_mmuidx_all_cpus_work(CPUState *src_cpu,
+                                                   run_on_cpu_data data)
+{
+    target_ulong addr = data.target_ptr & TARGET_PAGE_MASK;
+    uint16_t idxmap = data.target_ptr & ~TARGET_PAGE_MASK;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        tlb_flush_page_by_mmuidx_nocheck(cpu, addr, idxmap);
+    }
+}
+
+static void tlb_flush_all_cpus_run(CPUState *src_cpu, run_on_cpu_func func,
+                                   run_on_cpu_data data)
+{
+    if (qemu_tcg_mttcg_enabled() && src_cpu->created) {
+        async_safe_run_on_cpu(src_cpu, func, data);
+    } else {
+        func(src_cpu, data);
+    }
+}
+
+void tlb_flush_all_cpus_synced(CPUState *src_cpu, int flush_global)
+{
+    tlb_debug("(%d)\n", flush_global);
+
+    tlb_flush_all_cpus_run(src_cpu, tlb_flush_all_cpus_work, RUN_ON_CPU_NULL);
+}
+
+void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu, ...)
+{
+    va_list argp;
+    uint16_t idxmap;
+
+    va_start(argp, src_cpu);
+    idxmap = v_tlb_mmuidx_map(argp);
+    va_end(argp);
+
+    tlb_flush_all_cpus_run(src_cpu, tlb_flush_by_mmuidx_all_cpus_work,
+                           RUN_ON_CPU_HOST_INT(idxmap));
+}
+
+void tlb_flush_page_all_cpus_synced(CPUState *src_cpu, target_ulong addr)
+{
+    tlb_flush_all_cpus_run(src_cpu, tlb_flush_page_all_cpus_work,
+                           RUN_ON_CPU_TARGET_PTR(addr));
+}
+
+void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                              target_ulong addr, ...)
+{
+    va_list argp;
+    uint16_t idxmap;
+
+    va_start(argp, addr);
+    idxmap = v_tlb_mmuidx_map(argp);
+    va_end(argp);
+
+    addr = (addr & TARGET_PAGE_MASK) | idxmap;
+    tlb_flush_all_cpus_run(src_cpu, tlb_flush_page_by_mmuidx_all_cpus_work,
+                           RUN_ON_CPU_TARGET_PTR(addr));
+}
+
 /* update the TLBs so that writes to code in the virtual page 'addr'
    can be detected */
 void tlb_protect_code(ram_addr_t ram_addr)
@@ -230,9 +591,14 @@ static bool tlb_is_dirty_ram(CPUTLBEntry *tlbe)
     return (tlbe->addr_write & (TLB_INVALID_MASK|TLB_MMIO|TLB_NOTDIRTY)) == 0;
 }
 
+/* This is called for every vCPU from whichever thread clears the dirty
+ * bitmap, so with MTTCG the owner may be refilling the entry under our
+ * feet; only set TLB_NOTDIRTY if the entry is still the one we checked.
+ */
 void tlb_reset_dirty_range(CPUTLBEntry *tlb_entry, uintptr_t start,
                            uintptr_t length)
 {
+#if TCG_OVERSIZED_GUEST
     uintptr_t addr;
 
     if (tlb_is_dirty_ram(tlb_entry)) {
@@ -241,6 +607,18 @@ void tlb_reset_dirty_range(CPUTLBEntry *tlb_entry, uintptr_t start,
             tlb_entry->addr_write |= TLB_NOTDIRTY;
         }
     }
+#else
+    target_ulong orig_addr = atomic_read(&tlb_entry->addr_write);
+    uintptr_t addr;
+
+    if ((orig_addr & (TLB_INVALID_MASK | TLB_MMIO | TLB_NOTDIRTY)) == 0) {
+        addr = (orig_addr & TARGET_PAGE_MASK) + atomic_read(&tlb_entry->addend);
+        if ((addr - start) < length) {
+            atomic_cmpxchg(&tlb_entry->addr_write, orig_addr,
+                           orig_addr | TLB_NOTDIRTY);
+        }
+    }
+#endif
 }
 
 static inline ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr)
@@ -262,10 +640,11 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
     int mmu_idx;
 
     env = cpu->env_ptr;
+    qemu_spin_lock(&env->tlb_lock);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        unsigned int i;
+        size_t i, n = tlb_n_entries(env, mmu_idx);
 
-        for (i = 0; i < CPU_TLB_SIZE; i++) {
+        for (i = 0; i < n; i++) {
             tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i],
                                   start1, length);
         }
@@ -275,6 +654,7 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
                                   start1, length);
         }
     }
+    qemu_spin_unlock(&env->tlb_lock);
 }
 
 static inline void tlb_set_dirty1(CPUTLBEntry *tlb_entry, target_ulong vaddr)
@@ -289,13 +669,11 @@ static inline void tlb_set_dirty1(CPUTLBEntry *tlb_entry, target_ulong vaddr)
 void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
 {
     CPUArchState *env = cpu->env_ptr;
-    int i;
     int mmu_idx;
 
     vaddr &= TARGET_PAGE_MASK;
-    i = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        tlb_set_dirty1(&env->tlb_table[mmu_idx][i], vaddr);
+        tlb_set_dirty1(tlb_entry(env, mmu_idx, vaddr), vaddr);
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
@@ -378,12 +756,15 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     iotlb = memory_region_section_get_iotlb(cpu, section, vaddr, paddr, xlat,
                                             prot, &address);
 
-    index = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    index = tlb_index(env, mmu_idx, vaddr);
     te = &env->tlb_table[mmu_idx][index];
 
     /* do not discard the translation in te, evict it into a victim tlb */
     env->tlb_v_table[mmu_idx][vidx] = *te;
     env->iotlb_v[mmu_idx][vidx] = env->iotlb[mmu_idx][index];
+    if (tlb_entry_is_empty(te)) {
+        tlb_n_used_entries_inc(env, mmu_idx);
+    }
 
     /* refill the tlb */
     env->iotlb[mmu_idx][index].addr = iotlb - vaddr;
@@ -474,8 +855,8 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env1, target_ulong addr)
     CPUState *cpu = ENV_GET_CPU(env1);
     CPUIOTLBEntry *iotlbentry;
 
-    page_index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     mmu_idx = cpu_mmu_index(env1, true);
+    page_index = tlb_index(env1, mmu_idx, addr);
     if (unlikely(env1->tlb_table[mmu_idx][page_index].addr_code !=
                  (addr & TARGET_PAGE_MASK))) {
         cpu_ldub_code(env1, addr);
@@ -504,6 +885,7 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     hwaddr physaddr = iotlbentry->addr;
     MemoryRegion *mr = iotlb_to_region(cpu, physaddr, iotlbentry->attrs);
     uint64_t val;
+    bool locked = false;
 
     physaddr = (physaddr & TARGET_PAGE_MASK) + addr;
     cpu->mem_io_pc = retaddr;
@@ -512,7 +894,16 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     }
 
     cpu->mem_io_vaddr = addr;
+
+    /* MTTCG vCPUs run without the BQL, devices still expect it */
+    if (mr->global_locking && !qemu_mutex_iothread_locked()) {
+        qemu_mutex_lock_iothread();
+        locked = true;
+    }
     memory_region_dispatch_read(mr, physaddr, &val, size, iotlbentry->attrs);
+    if (locked) {
+        qemu_mutex_unlock_iothread();
+    }
     return val;
 }
 
@@ -523,6 +914,7 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     CPUState *cpu = ENV_GET_CPU(env);
     hwaddr physaddr = iotlbentry->addr;
     MemoryRegion *mr = iotlb_to_region(cpu, physaddr, iotlbentry->attrs);
+    bool locked = false;
 
     physaddr = (physaddr & TARGET_PAGE_MASK) + addr;
     if (mr != &io_mem_rom && mr != &io_mem_notdirty && !cpu->can_do_io) {
@@ -531,7 +923,15 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
 
     cpu->mem_io_vaddr = addr;
     cpu->mem_io_pc = retaddr;
+
+    if (mr->global_locking && !qemu_mutex_iothread_locked()) {
+        qemu_mutex_lock_iothread();
+        locked = true;
+    }
     memory_region_dispatch_write(mr, physaddr, val, size, iotlbentry->attrs);
+    if (locked) {
+        qemu_mutex_unlock_iothread();
+    }
 }
 
 /* Return true if ADDR is present in the victim tlb, and has been copied
@@ -550,6 +950,9 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
             CPUIOTLBEntry tmpio, *io = &env->iotlb[mmu_idx][index];
             CPUIOTLBEntry *vio = &env->iotlb_v[mmu_idx][vidx];
 
+            if (tlb_entry_is_empty(tlb)) {
+                tlb_n_used_entries_inc(env, mmu_idx);
+            }
             tmptlb = *tlb; *tlb = *vtlb; *vtlb = tmptlb;
             tmpio = *io; *io = *vio; *vio = tmpio;
             return true;
@@ -572,7 +975,7 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
 void probe_write(CPUArchState *env, target_ulong addr, int mmu_idx,
                  uintptr_t retaddr)
 {
-    int index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    int index = tlb_index(env, mmu_idx, addr);
     target_ulong tlb_addr = env->tlb_table[mmu_idx][index].addr_write;
 
     if ((addr & TARGET_PAGE_MASK)
@@ -590,7 +993,7 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
                                TCGMemOpIdx oi, uintptr_t retaddr)
 {
     size_t mmu_idx = get_mmuidx(oi);
-    size_t index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    size_t index = tlb_index(env, mmu_idx, addr);
     CPUTLBEntry *tlbe = &env->tlb_table[mmu_idx][index];
     target_ulong tlb_addr = tlbe->addr_write;
     TCGMemOp mop = get_memop(oi);
@@ -198,6 +198,10 @@ typedef struct subpage_t {
 static void io_mem_init(void);
 static void memory_map_init(void);
 static void tcg_commit(MemoryListener *listener);
+#ifdef TARGET_FIXED_MAPPING
+static void tcg_region_del(MemoryListener *listener,
+                           MemoryRegionSection *section);
+#endif
 
 static MemoryRegion io_mem_watch;
 
@@ -619,6 +623,9 @@ void cpu_address_space_init(CPUState *cpu, AddressSpace *as, int asidx)
     newas->as = as;
     if (tcg_enabled()) {
         newas->tcg_as_listener.commit = tcg_commit;
+#ifdef TARGET_FIXED_MAPPING
+        newas->tcg_as_listener.region_del = tcg_region_del;
+#endif
         memory_listener_register(&newas->tcg_as_listener, as);
     }
 }
@@ -642,6 +649,9 @@ void cpu_exec_unrealizefn(CPUState *cpu)
     if (qdev_get_vmsd(DEVICE(cpu)) == NULL) {
         vmstate_unregister(NULL, &vmstate_cpu_common, cpu);
     }
+#ifndef CONFIG_USER_ONLY
+    tlb_destroy(cpu);
+#endif
 }
 
 void cpu_exec_initfn(CPUState *cpu)
@@ -675,6 +685,8 @@ void cpu_exec_realizefn(CPUState *cpu, Error **errp)
     cpu_list_add(cpu);
 
 #ifndef CONFIG_USER_ONLY
+    tlb_init(cpu);
+
     if (qdev_get_vmsd(DEVICE(cpu)) == NULL) {
         vmstate_register(NULL, cpu->cpu_index, &vmstate_cpu_common, cpu);
     }
@@ -1033,6 +1045,82 @@ bool cpu_physical_memory_test_and_clear_dirty(ram_addr_t start,
     return dirty;
 }
 
+struct DirtyBitmapSnapshot {
+    ram_addr_t start;
+    ram_addr_t end;
+    unsigned long dirty[];
+};
+
+DirtyBitmapSnapshot *cpu_physical_memory_snapshot_and_clear_dirty
+    (ram_addr_t start, ram_addr_t length, unsigned client)
+{
+    DirtyMemoryBlocks *blocks;
+    unsigned long align = 1UL << (TARGET_PAGE_BITS + BITS_PER_LEVEL);
+    ram_addr_t first = QEMU_ALIGN_DOWN(start, align);
+    ram_addr_t last  = QEMU_ALIGN_UP(start + length, align);
+    DirtyBitmapSnapshot *snap;
+    unsigned long page, end, dest;
+
+    /* whole bitmap words are grabbed at once, the range is widened */
+    snap = g_malloc0(sizeof(*snap) +
+                     ((last - first) >> (TARGET_PAGE_BITS + 3)));
+    snap->start = first;
+    snap->end   = last;
+
+    page = first >> TARGET_PAGE_BITS;
+    end  = last  >> TARGET_PAGE_BITS;
+    dest = 0;
+
+    rcu_read_lock();
+
+    blocks = atomic_rcu_read(&ram_list.dirty_memory[client]);
+
+    while (page < end) {
+        unsigned long idx = page / DIRTY_MEMORY_BLOCK_SIZE;
+        unsigned long offset = page % DIRTY_MEMORY_BLOCK_SIZE;
+        unsigned long num = MIN(end - page, DIRTY_MEMORY_BLOCK_SIZE - offset);
+
+        assert(QEMU_IS_ALIGNED(offset, (1 << BITS_PER_LEVEL)));
+        assert(QEMU_IS_ALIGNED(num,    (1 << BITS_PER_LEVEL)));
+        offset >>= BITS_PER_LEVEL;
+
+        bitmap_copy_and_clear_atomic(snap->dirty + dest,
+                                     blocks->blocks[idx] + offset,
+                                     num);
+        page += num;
+        dest += num >> BITS_PER_LEVEL;
+    }
+
+    rcu_read_unlock();
+
+    if (tcg_enabled()) {
+        tlb_reset_dirty_range_all(start, length);
+    }
+
+    return snap;
+}
+
+bool cpu_physical_memory_snapshot_get_dirty(DirtyBitmapSnapshot *snap,
+                                            ram_addr_t start,
+                                            ram_addr_t length)
+{
+    unsigned long page, end;
+
+    assert(start >= snap->start);
+    assert(start + length <= snap->end);
+
+    end = TARGET_PAGE_ALIGN(start + length - snap->start) >> TARGET_PAGE_BITS;
+    page = (start - snap->start) >> TARGET_PAGE_BITS;
+
+    while (page < end) {
+        if (test_bit(page, snap->dirty)) {
+            return true;
+        }
+        page++;
+    }
+    return false;
+}
+
 /* Called from RCU critical section */
 hwaddr memory_region_section_get_iotlb(CPUState *cpu,
                                        MemoryRegionSection *section,
@@ -2320,6 +2408,10 @@ static void io_mem_init(void)
                           NULL, UINT64_MAX);
     memory_region_init_io(&io_mem_notdirty, NULL, &notdirty_mem_ops, NULL,
                           NULL, UINT64_MAX);
+    /* notdirty writes only touch RAM, the dirty bitmap and the TBs (under
+     * tb_lock), so MTTCG vCPUs need not take the BQL for them.
+     */
+    memory_region_clear_global_locking(&io_mem_notdirty);
     memory_region_init_io(&io_mem_watch, NULL, &watch_mem_ops, NULL,
                           NULL, UINT64_MAX);
 }
@@ -2382,6 +2474,28 @@ static void tcg_commit(MemoryListener *listener)
     tlb_flush(cpuas->cpu, 1);
 }
 
+#ifdef TARGET_FIXED_MAPPING
+/* Direct jumps between TBs were set up regardless of page boundaries and
+ * are only valid as long as the same RAM backs the same addresses.  Code
+ * writes are caught by the page-level TB tracking, but a removed or
+ * remapped region is not, so drop the code translated from its old
+ * backing; that also unlinks every jump into it.  Changes to dirty
+ * logging alone do not come through here.  */
+static void tcg_region_del(MemoryListener *listener,
+                           MemoryRegionSection *section)
+{
+    ram_addr_t start = memory_region_get_ram_addr(section->mr);
+
+    if (start == RAM_ADDR_INVALID) {
+        return;
+    }
+    start += section->offset_within_region;
+    tb_lock();
+    tb_invalidate_phys_range(start, start + int128_get64(section->size));
+    tb_unlock();
+}
+#endif
+
 void address_space_init_dispatch(AddressSpace *as)
 {
     as->dispatch = NULL;
@@ -184,6 +184,23 @@ STEXI
 @item info irq
 @findex irq
 Show the interrupts statistics (if available).
+ETEXI
+
+#if defined(TARGET_LM32)
+    {
+        .name       = "litex-pic",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show LiteX interrupt controller statistics",
+        .cmd        = hmp_info_litex_pic,
+    },
+#endif
+
+STEXI
+@item info litex-pic
+@findex litex-pic
+Show LiteX interrupt controller statistics: per-input counts, the
+raise-to-ack latency histogram and CPU interrupt line transitions (LM32 only).
 ETEXI
 
     {
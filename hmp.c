@@ -842,6 +842,39 @@ void hmp_info_irq(Monitor *mon, const QDict *qdict)
                                    hmp_info_irq_foreach, mon);
 }
 
+void hmp_info_litex_pic(Monitor *mon, const QDict *qdict)
+{
+    LitexPicInfoList *info_list, *info;
+    LitexPicIrqStatsList *irq;
+    intList *bucket;
+    Error *err = NULL;
+
+    info_list = qmp_query_litex_pic(&err);
+    if (err) {
+        hmp_handle_error(mon, &err);
+        return;
+    }
+
+    for (info = info_list; info; info = info->next) {
+        monitor_printf(mon, "%s: parent raises %" PRId64
+                       " lowers %" PRId64 "\n", info->value->path,
+                       info->value->parent_raises,
+                       info->value->parent_lowers);
+        for (irq = info->value->irqs; irq; irq = irq->next) {
+            monitor_printf(mon, "  irq %2" PRId64 ": %10" PRId64
+                           " latency(log2 us):", irq->value->irq,
+                           irq->value->count);
+            for (bucket = irq->value->latency; bucket;
+                 bucket = bucket->next) {
+                monitor_printf(mon, " %" PRId64, bucket->value);
+            }
+            monitor_printf(mon, "\n");
+        }
+    }
+
+    qapi_free_LitexPicInfoList(info_list);
+}
+
 static int hmp_info_pic_foreach(Object *obj, void *opaque)
 {
     InterruptStatsProvider *intc;
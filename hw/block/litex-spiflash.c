@@ -0,0 +1,564 @@
+/*
+ *  QEMU model of the LiteX SPI flash core.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * The core has a memory mapped XIP window onto the flash and a bitbang
+ * CSR interface used for ID, status, erase and program commands.
+ *
+ * The XIP window is read-only RAM.  With the "file" property the image is
+ * mmap()ed shared, so it boots without being copied and programmed data
+ * lands in the file directly.  With a "drive" the image is read into RAM
+ * and programmed sectors are written back through the block layer.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/hw.h"
+#include "hw/sysbus.h"
+#include "sysemu/block-backend.h"
+#include "qapi/error.h"
+#include "tcg.h"
+#include "translate-all.h"
+#include "qemu/error-report.h"
+#include "qemu/log.h"
+#include "trace.h"
+
+enum {
+    R_BITBANG = 0,
+    R_MISO,
+    R_BITBANG_EN,
+    R_MAX
+};
+
+#define BITBANG_MOSI    (1 << 0)
+#define BITBANG_CLK     (1 << 1)
+#define BITBANG_CS_N    (1 << 2)
+#define BITBANG_DIR     (1 << 3)
+
+/* SPI NOR commands */
+#define CMD_WRSR        0x01
+#define CMD_PP          0x02
+#define CMD_READ        0x03
+#define CMD_WRDI        0x04
+#define CMD_RDSR        0x05
+#define CMD_WREN        0x06
+#define CMD_FAST_READ   0x0b
+#define CMD_SE          0x20
+#define CMD_CE          0x60
+#define CMD_RDID        0x9f
+#define CMD_CE2         0xc7
+#define CMD_BE          0xd8
+
+#define SR_WEL          (1 << 1)
+
+#define FLASH_PAGE_SIZE       256
+#define FLASH_SECTOR_SIZE     4096
+#define FLASH_BLOCK_SIZE      65536
+
+enum {
+    STATE_IDLE,
+    STATE_ADDR,
+    STATE_DUMMY,
+    STATE_READ,
+    STATE_PROGRAM,
+    STATE_OUTPUT,
+    STATE_IGNORE,
+};
+
+#define TYPE_LITEX_SPIFLASH "litex-spiflash"
+#define LITEX_SPIFLASH(obj) \
+    OBJECT_CHECK(LitexSpiflashState, (obj), TYPE_LITEX_SPIFLASH)
+
+struct LitexSpiflashState {
+    SysBusDevice parent_obj;
+
+    MemoryRegion regs_region;
+    MemoryRegion xip;
+    uint8_t *storage;
+
+    BlockBackend *blk;
+    char *file;
+    uint32_t size;
+    uint32_t jedec_id;
+
+    /* bitbang shifter */
+    uint8_t in_byte;
+    uint8_t out_byte;
+    uint8_t bit_count;
+
+    /* command engine */
+    uint8_t state;
+    uint8_t cmd;
+    uint8_t addr_bytes;
+    uint8_t out_len;
+    uint8_t out_pos;
+    uint8_t out_buf[4];
+    uint8_t status;
+    uint32_t addr;
+    uint32_t page_len;
+    uint8_t page[FLASH_PAGE_SIZE];
+
+    uint32_t regs[R_MAX];
+};
+typedef struct LitexSpiflashState LitexSpiflashState;
+
+/*
+ * Store data into the XIP window.  The guest may execute the flash in
+ * place, so besides marking the pages dirty, drop any code translated
+ * from them.
+ */
+static void spiflash_store(LitexSpiflashState *s, uint32_t offset,
+                           const uint8_t *buf, uint32_t len)
+{
+    ram_addr_t addr = memory_region_get_ram_addr(&s->xip) + offset;
+
+    memcpy(s->storage + offset, buf, len);
+    memory_region_set_dirty(&s->xip, offset, len);
+    tb_lock();
+    tb_invalidate_phys_range(addr, addr + len);
+    tb_unlock();
+
+    if (s->blk) {
+        uint32_t start = QEMU_ALIGN_DOWN(offset, BDRV_SECTOR_SIZE);
+        uint32_t end = QEMU_ALIGN_UP(offset + len, BDRV_SECTOR_SIZE);
+
+        if (blk_pwrite(s->blk, start, s->storage + start,
+                       end - start, 0) < 0) {
+            error_report("litex_spiflash: failed to write back flash "
+                         "content at 0x%x", start);
+        }
+    }
+}
+
+static void spiflash_erase(LitexSpiflashState *s, uint32_t offset,
+                           uint32_t len)
+{
+    uint8_t *buf;
+
+    if (!(s->status & SR_WEL)) {
+        return;
+    }
+    offset = QEMU_ALIGN_DOWN(offset % s->size, len);
+    trace_litex_spiflash_erase(offset, len);
+
+    buf = g_malloc(len);
+    memset(buf, 0xff, len);
+    spiflash_store(s, offset, buf, len);
+    g_free(buf);
+}
+
+/* Page program: bits can only go from 1 to 0, the address wraps in-page. */
+static void spiflash_program(LitexSpiflashState *s)
+{
+    uint32_t base = QEMU_ALIGN_DOWN(s->addr % s->size, FLASH_PAGE_SIZE);
+    uint32_t start = s->addr % FLASH_PAGE_SIZE;
+    uint8_t buf[FLASH_PAGE_SIZE];
+    uint32_t i;
+
+    if (!(s->status & SR_WEL) || !s->page_len) {
+        return;
+    }
+    trace_litex_spiflash_program(base + start, s->page_len);
+
+    memcpy(buf, s->storage + base, FLASH_PAGE_SIZE);
+    for (i = 0; i < s->page_len; i++) {
+        buf[(start + i) % FLASH_PAGE_SIZE] &= s->page[i];
+    }
+    spiflash_store(s, base, buf, FLASH_PAGE_SIZE);
+}
+
+/* Chip select went high, commands with side effects complete now. */
+static void spiflash_deselect(LitexSpiflashState *s)
+{
+    if (s->state == STATE_PROGRAM) {
+        spiflash_program(s);
+        s->status &= ~SR_WEL;
+    } else if (s->state == STATE_IDLE && s->addr_bytes == 0) {
+        switch (s->cmd) {
+        case CMD_SE:
+            spiflash_erase(s, s->addr, FLASH_SECTOR_SIZE);
+            s->status &= ~SR_WEL;
+            break;
+        case CMD_BE:
+            spiflash_erase(s, s->addr, FLASH_BLOCK_SIZE);
+            s->status &= ~SR_WEL;
+            break;
+        case CMD_CE:
+        case CMD_CE2:
+            spiflash_erase(s, 0, s->size);
+            s->status &= ~SR_WEL;
+            break;
+        }
+    }
+
+    s->state = STATE_IDLE;
+    s->cmd = 0;
+    s->addr_bytes = 0;
+    s->page_len = 0;
+    s->bit_count = 0;
+    s->out_byte = 0xff;
+}
+
+static void spiflash_start_cmd(LitexSpiflashState *s, uint8_t cmd)
+{
+    trace_litex_spiflash_command(cmd);
+
+    s->cmd = cmd;
+    s->addr = 0;
+    s->addr_bytes = 0;
+    s->page_len = 0;
+
+    switch (cmd) {
+    case CMD_READ:
+    case CMD_FAST_READ:
+    case CMD_PP:
+    case CMD_SE:
+    case CMD_BE:
+        s->addr_bytes = 3;
+        s->state = STATE_ADDR;
+        break;
+    case CMD_RDSR:
+        s->out_buf[0] = s->status;
+        s->out_len = 1;
+        s->out_pos = 0;
+        s->state = STATE_OUTPUT;
+        break;
+    case CMD_RDID:
+        s->out_buf[0] = s->jedec_id >> 16;
+        s->out_buf[1] = s->jedec_id >> 8;
+        s->out_buf[2] = s->jedec_id;
+        s->out_len = 3;
+        s->out_pos = 0;
+        s->state = STATE_OUTPUT;
+        break;
+    case CMD_WREN:
+        s->status |= SR_WEL;
+        s->state = STATE_IDLE;
+        break;
+    case CMD_WRDI:
+        s->status &= ~SR_WEL;
+        s->state = STATE_IDLE;
+        break;
+    case CMD_CE:
+    case CMD_CE2:
+        s->state = STATE_IDLE;
+        break;
+    default:
+        qemu_log_mask(LOG_UNIMP,
+                      "litex_spiflash: unimplemented command 0x%02x\n", cmd);
+        /* fall through */
+    case CMD_WRSR:
+        s->state = STATE_IGNORE;
+        break;
+    }
+}
+
+/* Consume one byte from MOSI and return the byte to shift out on MISO. */
+static uint8_t spiflash_transfer(LitexSpiflashState *s, uint8_t in)
+{
+    switch (s->state) {
+    case STATE_IDLE:
+        if (!s->cmd) {
+            spiflash_start_cmd(s, in);
+        }
+        break;
+    case STATE_ADDR:
+        s->addr = (s->addr << 8) | in;
+        if (--s->addr_bytes == 0) {
+            if (s->cmd == CMD_READ) {
+                s->state = STATE_READ;
+                return s->storage[s->addr++ % s->size];
+            } else if (s->cmd == CMD_FAST_READ) {
+                s->state = STATE_DUMMY;
+            } else if (s->cmd == CMD_PP) {
+                s->state = STATE_PROGRAM;
+            } else {
+                s->state = STATE_IDLE;
+            }
+        }
+        break;
+    case STATE_DUMMY:
+        s->state = STATE_READ;
+        return s->storage[s->addr++ % s->size];
+    case STATE_READ:
+        return s->storage[s->addr++ % s->size];
+    case STATE_PROGRAM:
+        /* only the last FLASH_PAGE_SIZE bytes sent are programmed */
+        if (s->page_len == FLASH_PAGE_SIZE) {
+            memmove(s->page, s->page + 1, FLASH_PAGE_SIZE - 1);
+            s->page_len--;
+        }
+        s->page[s->page_len++] = in;
+        break;
+    case STATE_IGNORE:
+        break;
+    }
+
+    if (s->state == STATE_OUTPUT) {
+        uint8_t r = s->out_buf[s->out_pos];
+
+        /* status and id are repeated for as long as the master clocks */
+        s->out_pos = (s->out_pos + 1) % s->out_len;
+        if (s->cmd == CMD_RDSR) {
+            s->out_buf[0] = s->status;
+        }
+        return r;
+    }
+    return 0xff;
+}
+
+static void spiflash_bitbang(LitexSpiflashState *s, uint32_t value)
+{
+    uint32_t old = s->regs[R_BITBANG];
+
+    s->regs[R_BITBANG] = value;
+
+    if (value & BITBANG_CS_N) {
+        if (!(old & BITBANG_CS_N)) {
+            spiflash_deselect(s);
+        }
+        return;
+    }
+
+    /* sample MOSI on the rising clock edge */
+    if ((value & BITBANG_CLK) && !(old & BITBANG_CLK)) {
+        s->in_byte = (s->in_byte << 1) | (value & BITBANG_MOSI);
+        if (++s->bit_count == 8) {
+            s->out_byte = spiflash_transfer(s, s->in_byte);
+            s->bit_count = 0;
+        }
+    }
+}
+
+static uint64_t spiflash_read(void *opaque, hwaddr addr, unsigned size)
+{
+    LitexSpiflashState *s = opaque;
+    uint32_t r = 0;
+
+    addr >>= 2;
+    switch (addr) {
+    case R_MISO:
+        r = (s->out_byte >> (7 - s->bit_count)) & 1;
+        break;
+    case R_BITBANG:
+    case R_BITBANG_EN:
+        r = s->regs[addr];
+        break;
+
+    default:
+        error_report("litex_spiflash: read access to unknown register 0x"
+                TARGET_FMT_plx, addr << 2);
+        break;
+    }
+
+    return r;
+}
+
+static void spiflash_write(void *opaque, hwaddr addr, uint64_t value,
+                           unsigned size)
+{
+    LitexSpiflashState *s = opaque;
+
+    value &= 0xff;
+    addr >>= 2;
+    switch (addr) {
+    case R_BITBANG:
+        if (s->regs[R_BITBANG_EN]) {
+            spiflash_bitbang(s, value);
+        }
+        break;
+    case R_BITBANG_EN:
+        s->regs[addr] = value & 1;
+        if (!s->regs[addr]) {
+            /* the XIP engine takes over, end any bitbanged transaction */
+            spiflash_bitbang(s, BITBANG_CS_N);
+        }
+        break;
+    case R_MISO:
+        break;
+
+    default:
+        error_report("litex_spiflash: write access to unknown register 0x"
+                TARGET_FMT_plx, addr << 2);
+        break;
+    }
+}
+
+static const MemoryRegionOps spiflash_mmio_ops = {
+    .read = spiflash_read,
+    .write = spiflash_write,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static void litex_spiflash_reset(DeviceState *d)
+{
+    LitexSpiflashState *s = LITEX_SPIFLASH(d);
+    int i;
+
+    for (i = 0; i < R_MAX; i++) {
+        s->regs[i] = 0;
+    }
+    s->regs[R_BITBANG] = BITBANG_CS_N;
+    s->status = 0;
+    s->in_byte = 0;
+    s->state = STATE_IDLE;
+    s->cmd = 0;
+    spiflash_deselect(s);
+}
+
+static void litex_spiflash_init_file(LitexSpiflashState *s, Error **errp)
+{
+#ifdef __linux__
+    struct stat st;
+    off_t old_size = 0;
+    Error *err = NULL;
+
+    /* the backing file is resized to the flash size, never shrink it */
+    if (stat(s->file, &st) == 0) {
+        if (st.st_size > s->size) {
+            error_setg(errp, "litex_spiflash: image '%s' is larger than the "
+                       "flash (%u bytes)", s->file, s->size);
+            return;
+        }
+        old_size = st.st_size;
+    }
+    memory_region_init_ram_from_file(&s->xip, OBJECT(s), "litex-spiflash.xip",
+                                     s->size, true, s->file, &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    /* growing the file reads back zeroes, erased flash reads back ones */
+    memset((uint8_t *)memory_region_get_ram_ptr(&s->xip) + old_size, 0xff,
+           s->size - old_size);
+#else
+    error_setg(errp, "litex_spiflash: mmap()ed images need a Linux host");
+#endif
+}
+
+static void litex_spiflash_realize(DeviceState *dev, Error **errp)
+{
+    LitexSpiflashState *s = LITEX_SPIFLASH(dev);
+    Error *err = NULL;
+
+    if (!s->size || (s->size & (FLASH_SECTOR_SIZE - 1))) {
+        error_setg(errp, "litex_spiflash: size must be a multiple of %d",
+                   FLASH_SECTOR_SIZE);
+        return;
+    }
+    if (s->file && s->blk) {
+        error_setg(errp, "litex_spiflash: 'file' and 'drive' are exclusive");
+        return;
+    }
+
+    if (s->file) {
+        litex_spiflash_init_file(s, &err);
+    } else {
+        memory_region_init_ram(&s->xip, OBJECT(dev), "litex-spiflash.xip",
+                               s->size, &err);
+    }
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    memory_region_set_readonly(&s->xip, true);
+    vmstate_register_ram(&s->xip, dev);
+    s->storage = memory_region_get_ram_ptr(&s->xip);
+
+    if (s->blk) {
+        int64_t len = MIN(blk_getlength(s->blk), s->size);
+
+        memset(s->storage, 0xff, s->size);
+        if (len > 0 && blk_pread(s->blk, 0, s->storage, len) < 0) {
+            vmstate_unregister_ram(&s->xip, dev);
+            error_setg(errp, "failed to read the initial flash content");
+            return;
+        }
+    } else if (!s->file) {
+        memset(s->storage, 0xff, s->size);
+    }
+
+    sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->xip);
+}
+
+static void litex_spiflash_init(Object *obj)
+{
+    LitexSpiflashState *s = LITEX_SPIFLASH(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+
+    memory_region_init_io(&s->regs_region, obj, &spiflash_mmio_ops, s,
+                          "litex-spiflash", R_MAX * 4);
+    sysbus_init_mmio(sbd, &s->regs_region);
+}
+
+static const VMStateDescription vmstate_litex_spiflash = {
+    .name = "litex-spiflash",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, LitexSpiflashState, R_MAX),
+        VMSTATE_UINT8(in_byte, LitexSpiflashState),
+        VMSTATE_UINT8(out_byte, LitexSpiflashState),
+        VMSTATE_UINT8(bit_count, LitexSpiflashState),
+        VMSTATE_UINT8(state, LitexSpiflashState),
+        VMSTATE_UINT8(cmd, LitexSpiflashState),
+        VMSTATE_UINT8(addr_bytes, LitexSpiflashState),
+        VMSTATE_UINT8(out_len, LitexSpiflashState),
+        VMSTATE_UINT8(out_pos, LitexSpiflashState),
+        VMSTATE_UINT8_ARRAY(out_buf, LitexSpiflashState, 4),
+        VMSTATE_UINT8(status, LitexSpiflashState),
+        VMSTATE_UINT32(addr, LitexSpiflashState),
+        VMSTATE_UINT32(page_len, LitexSpiflashState),
+        VMSTATE_UINT8_ARRAY(page, LitexSpiflashState, FLASH_PAGE_SIZE),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property litex_spiflash_properties[] = {
+    DEFINE_PROP_DRIVE("drive", LitexSpiflashState, blk),
+    DEFINE_PROP_STRING("file", LitexSpiflashState, file),
+    DEFINE_PROP_UINT32("size", LitexSpiflashState, size, 16 * 1024 * 1024),
+    DEFINE_PROP_UINT32("jedec-id", LitexSpiflashState, jedec_id, 0xef4018),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void litex_spiflash_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = litex_spiflash_realize;
+    dc->reset = litex_spiflash_reset;
+    dc->vmsd = &vmstate_litex_spiflash;
+    dc->props = litex_spiflash_properties;
+}
+
+static const TypeInfo litex_spiflash_info = {
+    .name          = TYPE_LITEX_SPIFLASH,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(LitexSpiflashState),
+    .instance_init = litex_spiflash_init,
+    .class_init    = litex_spiflash_class_init,
+};
+
+static void litex_spiflash_register_types(void)
+{
+    type_register_static(&litex_spiflash_info);
+}
+
+type_init(litex_spiflash_register_types)
@@ -25,6 +25,8 @@
 #include "trace.h"
 #include "sysemu/char.h"
 #include "qemu/error-report.h"
+#include "qemu/log.h"
+#include "qemu/fifo8.h"
 
 
 enum {
@@ -46,65 +48,121 @@ enum {
     OBJECT_CHECK(LitexUartState, (obj), TYPE_LITEX_UART)
 
 
-struct char_fifo {
-    uint8_t fifo[FIFO_DEPTH];
-    uint32_t fifo_cnt;
-    uint32_t fifo_wr_idx;
-    uint32_t fifo_rd_idx;
-    uint8_t fifo_empty;
-    uint8_t fifo_full;
+struct LitexUartState {
+    SysBusDevice parent_obj;
+
+    Fifo8 rx_fifo;
+    uint8_t tx_fifo[FIFO_DEPTH];
+    uint32_t tx_count;
+    QEMUBH *tx_bh;
+    guint watch_tag;
+    int irqstate;
+    MemoryRegion regs_region;
+    CharBackend chr;
+    qemu_irq irq;
+
+    uint32_t regs[CSR_UART_R_MAX];
 };
+typedef struct LitexUartState LitexUartState;
 
-static void write_fifo(struct char_fifo *f, char c)
+static void uart_update_irq(LitexUartState *s)
 {
-   
-    if(!f->fifo_full)
-    {
-        f->fifo[f->fifo_wr_idx] = c;
-        f->fifo_wr_idx = (f->fifo_wr_idx + 1) % FIFO_DEPTH;
-        // printf("fifo_wr_idx:%d\n", f->fifo_wr_idx);
-        f->fifo_empty = 0;
-        if(f->fifo_wr_idx == f->fifo_rd_idx)
-        {
-            f->fifo_full = 1;
+    if (s->regs[CSR_UART_EV_PENDING_ADDR] & s->regs[CSR_UART_EV_ENABLE_ADDR]) {
+        if (!s->irqstate) {
+            s->irqstate = 1;
+            trace_litex_uart_raise_irq();
+            qemu_irq_raise(s->irq);
         }
-        f->fifo_cnt++;
-    } else {
-        printf("can't write, fifo full %d %d!\n", f->fifo_wr_idx, f->fifo_rd_idx);
+    } else if (s->irqstate) {
+        s->irqstate = 0;
+        trace_litex_uart_lower_irq();
+        qemu_irq_lower(s->irq);
     }
 }
 
-static unsigned char read_fifo(struct char_fifo *f)
+static void uart_update_tx_status(LitexUartState *s)
 {
-    return f->fifo[f->fifo_rd_idx];;
+    bool was_full = s->regs[CSR_UART_TXFULL_ADDR];
+    bool full = s->tx_count == FIFO_DEPTH;
+
+    s->regs[CSR_UART_TXFULL_ADDR] = full;
+    if (full) {
+        s->regs[CSR_UART_EV_STATUS_ADDR] |= UART_EV_TX;
+    } else {
+        s->regs[CSR_UART_EV_STATUS_ADDR] &= ~UART_EV_TX;
+        /* the tx event fires when the fifo stops being full */
+        if (was_full) {
+            s->regs[CSR_UART_EV_PENDING_ADDR] |= UART_EV_TX;
+        }
+    }
+    uart_update_irq(s);
 }
 
-static void pop_fifo(struct char_fifo *f)
+static gboolean uart_xmit(GIOChannel *chan, GIOCondition cond, void *opaque)
 {
-    if(f->fifo_cnt){
-        f->fifo_rd_idx = (f->fifo_rd_idx + 1) % FIFO_DEPTH;
-        //printf("fifo_rd_idx:%d\n", f->fifo_rd_idx);
-        f->fifo_full = 0;
-        if(f->fifo_rd_idx == f->fifo_wr_idx)
-        {
-            f->fifo_empty = 1;
+    LitexUartState *s = opaque;
+    int ret;
+
+    s->watch_tag = 0;
+
+    /* instant drain the fifo when there's no back-end */
+    if (!qemu_chr_fe_get_driver(&s->chr)) {
+        s->tx_count = 0;
+        uart_update_tx_status(s);
+        return FALSE;
+    }
+
+    if (!s->tx_count) {
+        return FALSE;
+    }
+
+    ret = qemu_chr_fe_write(&s->chr, s->tx_fifo, s->tx_count);
+    if (ret > 0) {
+        s->tx_count -= ret;
+        memmove(s->tx_fifo, s->tx_fifo + ret, s->tx_count);
+    }
+
+    if (s->tx_count) {
+        s->watch_tag = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                             uart_xmit, s);
+        if (!s->watch_tag) {
+            /* backend can't be polled, fall back to a blocking write */
+            qemu_chr_fe_write_all(&s->chr, s->tx_fifo, s->tx_count);
+            s->tx_count = 0;
         }
-        f->fifo_cnt--;
     }
+
+    uart_update_tx_status(s);
+    return FALSE;
 }
 
-struct LitexUartState {
-    SysBusDevice parent_obj;
+static void uart_tx_bh(void *opaque)
+{
+    LitexUartState *s = opaque;
 
-    struct char_fifo rx_fifo;
-    int irqstate;
-    MemoryRegion regs_region;
-    CharBackend chr;
-    qemu_irq irq;
+    if (!s->watch_tag) {
+        uart_xmit(NULL, G_IO_OUT, s);
+    }
+}
 
-    uint32_t regs[CSR_UART_R_MAX];
-};
-typedef struct LitexUartState LitexUartState;
+static void uart_tx_push(LitexUartState *s, uint8_t ch)
+{
+    if (s->tx_count == FIFO_DEPTH) {
+        qemu_log_mask(LOG_GUEST_ERROR, "litex_uart: tx fifo overrun\n");
+        return;
+    }
+
+    s->tx_fifo[s->tx_count++] = ch;
+    uart_update_tx_status(s);
+
+    /*
+     * Characters written back to back are collected here and handed to
+     * the backend in one go once the vCPU lets the main loop run.
+     */
+    if (!s->watch_tag) {
+        qemu_bh_schedule(s->tx_bh);
+    }
+}
 
 
 static uint64_t uart_read(void *opaque, hwaddr addr, unsigned size)
@@ -118,11 +176,16 @@ static uint64_t uart_read(void *opaque, hwaddr addr, unsigned size)
     {
         
     case CSR_UART_RXTX_ADDR:
-        r = read_fifo(&s->rx_fifo);
+        if (!fifo8_is_empty(&s->rx_fifo)) {
+            r = fifo8_peek(&s->rx_fifo);
+        }
         break;
         
-    case CSR_UART_TXFULL_ADDR:
     case CSR_UART_RXEMPTY_ADDR:
+        r = fifo8_is_empty(&s->rx_fifo);
+        break;
+
+    case CSR_UART_TXFULL_ADDR:
     case CSR_UART_EV_PENDING_ADDR:
     case CSR_UART_EV_STATUS_ADDR:
     case CSR_UART_EV_ENABLE_ADDR:
@@ -150,39 +213,32 @@ static void uart_write(void *opaque, hwaddr addr, uint64_t value,    unsigned si
     switch(addr)
     {
     case CSR_UART_RXTX_ADDR:
-        qemu_chr_fe_write_all(&s->chr, &ch, 1);
+        uart_tx_push(s, ch);
         break;
 
     case CSR_UART_EV_PENDING_ADDR:
         if(value & UART_EV_RX)
         {
-            //printf("pop fifo !\n");
-            pop_fifo(&s->rx_fifo);
-            if(s->rx_fifo.fifo_empty)
-            {
-                s->regs[CSR_UART_RXEMPTY_ADDR] = 1;
+            if (!fifo8_is_empty(&s->rx_fifo)) {
+                fifo8_pop(&s->rx_fifo);
+                /* room freed up, let the backend send the next chars */
+                qemu_chr_fe_accept_input(&s->chr);
             }
+            s->regs[CSR_UART_RXEMPTY_ADDR] = fifo8_is_empty(&s->rx_fifo);
             s->regs[CSR_UART_EV_PENDING_ADDR] &= ~UART_EV_RX;    
         }
         if(value & UART_EV_TX)
         {
             s->regs[CSR_UART_EV_PENDING_ADDR] &= ~UART_EV_TX;
         }
-        if(!s->regs[CSR_UART_EV_PENDING_ADDR])
-        {
-            if(s->irqstate)
-            {
-                qemu_irq_lower(s->irq);
-                //  printf("irq lower\n");
-                s->irqstate=0;
-            }
-        }
+        uart_update_irq(s);
         break;
 
 
     case CSR_UART_EV_ENABLE_ADDR:
         
         s->regs[addr] = ch;
+        uart_update_irq(s);
         break;
 
 
@@ -208,39 +264,31 @@ static void uart_rx(void *opaque, const uint8_t *buf, int size)
 {
 
     LitexUartState *s = opaque;
-    int i;
-    for(i = 0; i < size; i++)
-    {
-        write_fifo(&s->rx_fifo, buf[i]);
+    uint32_t num = MIN(size, fifo8_num_free(&s->rx_fifo));
+
+    /* uart_can_rx() throttles the backend, so this should never trigger */
+    if (num < size) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "litex_uart: rx fifo overflow, dropping %d chars\n",
+                      size - (int)num);
     }
-    
-    s->regs[CSR_UART_RXEMPTY_ADDR] = 0;
-    
+    fifo8_push_all(&s->rx_fifo, buf, num);
+
+    s->regs[CSR_UART_RXEMPTY_ADDR] = fifo8_is_empty(&s->rx_fifo);
 
-    //printf("Got uart_rx %d\n", size);
     if(s->regs[CSR_UART_EV_ENABLE_ADDR] & UART_EV_RX)
     {
-
         s->regs[CSR_UART_EV_PENDING_ADDR] |= UART_EV_RX;
-        if(!s->irqstate)
-        {
-            s->irqstate=1;
-            //printf("raise irq\n");
-            qemu_irq_raise(s->irq);
-        }
-        
+        uart_update_irq(s);
     }
-    
 }
 
 static int uart_can_rx(void *opaque)
 {
     
     LitexUartState *s = opaque;
-    
-    //printf("got uart_can_rx %d %d\n",FIFO_DEPTH - s->rx_fifo.fifo_cnt, !s->rx_fifo.fifo_full);
-    //return !s->rx_fifo.fifo_full;
-    return FIFO_DEPTH - s->rx_fifo.fifo_cnt;
+
+    return fifo8_num_free(&s->rx_fifo);
 }
 
 static void uart_event(void *opaque, int event)
@@ -258,9 +306,15 @@ static void litex_uart_reset(DeviceState *d)
         s->regs[i] = 0;
     }
     s->irqstate=0;
-    memset((void*)&s->rx_fifo, 0, sizeof(s->rx_fifo));
+    fifo8_reset(&s->rx_fifo);
+    s->regs[CSR_UART_RXEMPTY_ADDR] = 1;
 
-    s->rx_fifo.fifo_empty = 1;
+    if (s->watch_tag) {
+        g_source_remove(s->watch_tag);
+        s->watch_tag = 0;
+    }
+    qemu_bh_cancel(s->tx_bh);
+    s->tx_count = 0;
     
     //printf("litex uart reset\n");
        
@@ -271,6 +325,7 @@ static void litex_uart_realize(DeviceState *dev, Error **errp)
 
       LitexUartState *s = LITEX_UART(dev);
       qemu_chr_fe_set_handlers(&s->chr, uart_can_rx, uart_rx,  uart_event, s, NULL, true);
+      s->tx_bh = qemu_bh_new(uart_tx_bh, s);
 
       //printf("litex uart realize\n");
 }
@@ -281,16 +336,35 @@ static void litex_uart_init(Object *obj)
     LitexUartState *s = LITEX_UART(obj);
 
     sysbus_init_irq(sbd, &s->irq);
+    fifo8_create(&s->rx_fifo, FIFO_DEPTH);
     memory_region_init_io(&s->regs_region, OBJECT(s), &uart_mmio_ops, s, "litex-uart", CSR_UART_R_MAX * 4);
     sysbus_init_mmio(sbd, &s->regs_region);
 }
 
+static int litex_uart_post_load(void *opaque, int version_id)
+{
+    LitexUartState *s = opaque;
+
+    if (s->tx_count > FIFO_DEPTH) {
+        return -EINVAL;
+    }
+    s->regs[CSR_UART_RXEMPTY_ADDR] = fifo8_is_empty(&s->rx_fifo);
+    if (s->tx_count) {
+        qemu_bh_schedule(s->tx_bh);
+    }
+    return 0;
+}
+
 static const VMStateDescription vmstate_litex_uart = {
     .name = "litex-uart",
-    .version_id = 1,
-    .minimum_version_id = 1,
+    .version_id = 3,
+    .minimum_version_id = 2,
+    .post_load = litex_uart_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, LitexUartState, CSR_UART_R_MAX),
+        VMSTATE_UINT8_ARRAY(tx_fifo, LitexUartState, FIFO_DEPTH),
+        VMSTATE_UINT32(tx_count, LitexUartState),
+        VMSTATE_FIFO8_V(rx_fifo, LitexUartState, 3),
         VMSTATE_END_OF_LIST()
     }
 };
@@ -0,0 +1,386 @@
+/*
+ *  QEMU model of the LiteX video framebuffer.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * The VideoFramebuffer core is a WishboneDMAReader scanning a linear
+ * framebuffer in main RAM, looping, plus a video timing generator.  It has
+ * two CSR blocks, mapped separately: the DMA channel (see litex-dma.h) and
+ * the timing generator.
+ *
+ * Display updates only look at scanlines whose pages were written since
+ * the last refresh.  When the pixel format is one pixman knows, the
+ * console surface is backed by guest RAM directly and an update costs
+ * nothing but the dirty bitmap scan; otherwise dirty lines are converted
+ * into a 32bpp shadow surface.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/hw.h"
+#include "hw/sysbus.h"
+#include "hw/dma/litex-dma.h"
+#include "trace.h"
+#include "ui/console.h"
+#include "framebuffer.h"
+#include "ui/pixel_ops.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+
+enum {
+    R_VTG_ENABLE = 0,
+    R_VTG_HRES0,
+    R_VTG_HSYNC_START0 = R_VTG_HRES0 + 2,
+    R_VTG_HSYNC_END0 = R_VTG_HSYNC_START0 + 2,
+    R_VTG_HSCAN0 = R_VTG_HSYNC_END0 + 2,
+    R_VTG_VRES0 = R_VTG_HSCAN0 + 2,
+    R_VTG_VSYNC_START0 = R_VTG_VRES0 + 2,
+    R_VTG_VSYNC_END0 = R_VTG_VSYNC_START0 + 2,
+    R_VTG_VSCAN0 = R_VTG_VSYNC_END0 + 2,
+    R_VTG_MAX = R_VTG_VSCAN0 + 2
+};
+
+#define TYPE_LITEX_FRAMEBUFFER "litex-framebuffer"
+#define LITEX_FRAMEBUFFER(obj) \
+    OBJECT_CHECK(LitexFramebufferState, (obj), TYPE_LITEX_FRAMEBUFFER)
+
+struct LitexFramebufferState {
+    SysBusDevice parent_obj;
+
+    MemoryRegion dma_region;
+    MemoryRegion vtg_region;
+    MemoryRegionSection fbsection;
+    QemuConsole *con;
+
+    int invalidate;
+    bool zero_copy;
+    uint32_t depth;
+    bool big_endian;
+
+    LitexDMAChannel dma;
+    uint8_t vtg_regs[R_VTG_MAX];
+};
+typedef struct LitexFramebufferState LitexFramebufferState;
+
+static unsigned fb_get_reg16(LitexFramebufferState *s, int reg)
+{
+    return (s->vtg_regs[reg] << 8) | s->vtg_regs[reg + 1];
+}
+
+static bool fb_enabled(LitexFramebufferState *s)
+{
+    return s->vtg_regs[R_VTG_ENABLE] && s->dma.regs[LITEX_DMA_ENABLE] &&
+           fb_get_reg16(s, R_VTG_HRES0) && fb_get_reg16(s, R_VTG_VRES0);
+}
+
+static void fb_draw_line(LitexFramebufferState *s, uint8_t *d,
+                         const uint8_t *src, int width)
+{
+    uint32_t *dst = (uint32_t *)d;
+    unsigned r, g, b, v;
+
+    while (width--) {
+        if (s->depth == 16) {
+            v = s->big_endian ? lduw_be_p(src) : lduw_le_p(src);
+            r = (v >> 8) & 0xf8;
+            g = (v >> 3) & 0xfc;
+            b = (v << 3) & 0xf8;
+            src += 2;
+        } else {
+            v = s->big_endian ? ldl_be_p(src) : ldl_le_p(src);
+            r = (v >> 16) & 0xff;
+            g = (v >> 8) & 0xff;
+            b = v & 0xff;
+            src += 4;
+        }
+        *dst++ = rgb_to_pixel32(r, g, b);
+    }
+}
+
+/* map the framebuffer and pick the console surface */
+static bool fb_setup(LitexFramebufferState *s, int width, int height)
+{
+    SysBusDevice *sbd = SYS_BUS_DEVICE(s);
+    int stride = width * (s->depth / 8);
+    pixman_format_code_t format;
+    DisplaySurface *surface;
+    uint8_t *ptr;
+
+    framebuffer_update_memory_section(&s->fbsection,
+                                      sysbus_address_space(sbd),
+                                      litex_dma_channel_addr(&s->dma) -
+                                      s->dma.offset,
+                                      height, stride);
+    if (!s->fbsection.mr) {
+        return false;
+    }
+
+#ifdef HOST_WORDS_BIGENDIAN
+    format = qemu_default_pixman_format(s->depth, s->big_endian);
+#else
+    format = qemu_default_pixman_format(s->depth, !s->big_endian);
+#endif
+    s->zero_copy = format != 0;
+    if (s->zero_copy) {
+        ptr = memory_region_get_ram_ptr(s->fbsection.mr) +
+              s->fbsection.offset_within_region;
+        surface = qemu_create_displaysurface_from(width, height, format,
+                                                  stride, ptr);
+        dpy_gfx_replace_surface(s->con, surface);
+    } else {
+        qemu_console_resize(s->con, width, height);
+    }
+
+    trace_litex_framebuffer_setup(width, height, s->depth, s->zero_copy);
+    return true;
+}
+
+static void fb_update_display(void *opaque)
+{
+    LitexFramebufferState *s = opaque;
+    DirtyBitmapSnapshot *snap;
+    DisplaySurface *surface;
+    MemoryRegion *mr;
+    hwaddr offset;
+    int width, height, stride, y;
+    int first = -1;
+    int last = 0;
+    uint8_t *src;
+
+    if (!fb_enabled(s)) {
+        return;
+    }
+
+    width = fb_get_reg16(s, R_VTG_HRES0);
+    height = fb_get_reg16(s, R_VTG_VRES0);
+    stride = width * (s->depth / 8);
+
+    if (s->invalidate && !fb_setup(s, width, height)) {
+        return;
+    }
+    if (!s->fbsection.mr) {
+        return;
+    }
+
+    mr = s->fbsection.mr;
+    offset = s->fbsection.offset_within_region;
+    snap = memory_region_snapshot_and_clear_dirty(mr, offset,
+                                                  (hwaddr)stride * height,
+                                                  DIRTY_MEMORY_VGA);
+    surface = qemu_console_surface(s->con);
+    src = memory_region_get_ram_ptr(mr) + offset;
+
+    for (y = 0; y < height; y++, offset += stride, src += stride) {
+        if (s->invalidate ||
+            memory_region_snapshot_get_dirty(mr, snap, offset, stride)) {
+            if (!s->zero_copy) {
+                fb_draw_line(s, surface_data(surface) +
+                                y * surface_stride(surface), src, width);
+            }
+            if (first < 0) {
+                first = y;
+            }
+            last = y;
+        } else if (first >= 0) {
+            dpy_gfx_update(s->con, 0, first, width, last - first + 1);
+            first = -1;
+        }
+    }
+    if (first >= 0) {
+        dpy_gfx_update(s->con, 0, first, width, last - first + 1);
+    }
+
+    g_free(snap);
+    s->invalidate = 0;
+}
+
+static void fb_invalidate_display(void *opaque)
+{
+    LitexFramebufferState *s = opaque;
+    s->invalidate = 1;
+}
+
+static uint64_t dma_read(void *opaque, hwaddr addr, unsigned size)
+{
+    LitexFramebufferState *s = opaque;
+
+    addr >>= 2;
+    if (addr >= LITEX_DMA_R_MAX) {
+        error_report("litex_framebuffer: read access to unknown dma "
+                "register 0x" TARGET_FMT_plx, addr << 2);
+        return 0;
+    }
+
+    return litex_dma_channel_read(&s->dma, addr);
+}
+
+static void dma_write(void *opaque, hwaddr addr, uint64_t value,
+                      unsigned size)
+{
+    LitexFramebufferState *s = opaque;
+
+    addr >>= 2;
+    if (addr >= LITEX_DMA_R_MAX) {
+        error_report("litex_framebuffer: write access to unknown dma "
+                "register 0x" TARGET_FMT_plx, addr << 2);
+        return;
+    }
+
+    /* the scanout never completes, base and length take effect at once */
+    litex_dma_channel_write(&s->dma, addr, value);
+    s->invalidate = 1;
+}
+
+static uint64_t vtg_read(void *opaque, hwaddr addr, unsigned size)
+{
+    LitexFramebufferState *s = opaque;
+
+    addr >>= 2;
+    if (addr >= R_VTG_MAX) {
+        error_report("litex_framebuffer: read access to unknown vtg "
+                "register 0x" TARGET_FMT_plx, addr << 2);
+        return 0;
+    }
+
+    return s->vtg_regs[addr];
+}
+
+static void vtg_write(void *opaque, hwaddr addr, uint64_t value,
+                      unsigned size)
+{
+    LitexFramebufferState *s = opaque;
+
+    addr >>= 2;
+    if (addr >= R_VTG_MAX) {
+        error_report("litex_framebuffer: write access to unknown vtg "
+                "register 0x" TARGET_FMT_plx, addr << 2);
+        return;
+    }
+
+    s->vtg_regs[addr] = value;
+    if (addr == R_VTG_ENABLE ||
+        (addr >= R_VTG_HRES0 && addr < R_VTG_HRES0 + 2) ||
+        (addr >= R_VTG_VRES0 && addr < R_VTG_VRES0 + 2)) {
+        s->invalidate = 1;
+    }
+}
+
+static const MemoryRegionOps dma_mmio_ops = {
+    .read = dma_read,
+    .write = dma_write,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static const MemoryRegionOps vtg_mmio_ops = {
+    .read = vtg_read,
+    .write = vtg_write,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static void litex_framebuffer_reset(DeviceState *d)
+{
+    LitexFramebufferState *s = LITEX_FRAMEBUFFER(d);
+
+    litex_dma_channel_reset(&s->dma);
+    memset(s->vtg_regs, 0, sizeof(s->vtg_regs));
+    s->invalidate = 1;
+}
+
+static const GraphicHwOps fb_ops = {
+    .invalidate  = fb_invalidate_display,
+    .gfx_update  = fb_update_display,
+};
+
+static void litex_framebuffer_init(Object *obj)
+{
+    LitexFramebufferState *s = LITEX_FRAMEBUFFER(obj);
+    SysBusDevice *dev = SYS_BUS_DEVICE(obj);
+
+    memory_region_init_io(&s->dma_region, obj, &dma_mmio_ops, s,
+            "litex-framebuffer.dma", LITEX_DMA_R_MAX * 4);
+    sysbus_init_mmio(dev, &s->dma_region);
+    memory_region_init_io(&s->vtg_region, obj, &vtg_mmio_ops, s,
+            "litex-framebuffer.vtg", R_VTG_MAX * 4);
+    sysbus_init_mmio(dev, &s->vtg_region);
+}
+
+static void litex_framebuffer_realize(DeviceState *dev, Error **errp)
+{
+    LitexFramebufferState *s = LITEX_FRAMEBUFFER(dev);
+
+    if (s->depth != 16 && s->depth != 32) {
+        error_setg(errp, "depth must be 16 or 32");
+        return;
+    }
+
+    s->con = graphic_console_init(dev, 0, &fb_ops, s);
+}
+
+static int fb_post_load(void *opaque, int version_id)
+{
+    fb_invalidate_display(opaque);
+    return 0;
+}
+
+static const VMStateDescription vmstate_litex_framebuffer = {
+    .name = "litex-framebuffer",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = fb_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT(dma, LitexFramebufferState, 1,
+                       vmstate_litex_dma_channel, LitexDMAChannel),
+        VMSTATE_UINT8_ARRAY(vtg_regs, LitexFramebufferState, R_VTG_MAX),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property litex_framebuffer_properties[] = {
+    DEFINE_PROP_UINT32("depth", LitexFramebufferState, depth, 32),
+    DEFINE_PROP_BOOL("big-endian", LitexFramebufferState, big_endian, true),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void litex_framebuffer_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->reset = litex_framebuffer_reset;
+    dc->vmsd = &vmstate_litex_framebuffer;
+    dc->props = litex_framebuffer_properties;
+    dc->realize = litex_framebuffer_realize;
+}
+
+static const TypeInfo litex_framebuffer_info = {
+    .name          = TYPE_LITEX_FRAMEBUFFER,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(LitexFramebufferState),
+    .instance_init = litex_framebuffer_init,
+    .class_init    = litex_framebuffer_class_init,
+};
+
+static void litex_framebuffer_register_types(void)
+{
+    type_register_static(&litex_framebuffer_info);
+}
+
+type_init(litex_framebuffer_register_types)
@@ -0,0 +1,429 @@
+/*
+ *  QEMU model of a LiteX DMA engine.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * A WishboneDMAReader and a WishboneDMAWriter whose streams are connected
+ * back to back, i.e. a memory to memory copy engine, plus an event block
+ * signalling completion of either side.  The data is moved in large
+ * chunks with address_space_rw() from a timer, so the guest keeps running
+ * while a transfer is in flight; the "bandwidth" property paces it in
+ * virtual time, a chunk only completing once the time it takes at that
+ * bandwidth has passed.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/hw.h"
+#include "hw/sysbus.h"
+#include "hw/dma/litex-dma.h"
+#include "exec/address-spaces.h"
+#include "qemu/timer.h"
+#include "qemu/error-report.h"
+#include "trace.h"
+
+/* channel helpers, shared with the DMA of other LiteX cores */
+
+static uint32_t dma_get_reg32(LitexDMAChannel *ch, int reg)
+{
+    return (ch->regs[reg] << 24) | (ch->regs[reg + 1] << 16) |
+           (ch->regs[reg + 2] << 8) | ch->regs[reg + 3];
+}
+
+void litex_dma_channel_reset(LitexDMAChannel *ch)
+{
+    memset(ch->regs, 0, sizeof(ch->regs));
+    ch->offset = 0;
+}
+
+uint32_t litex_dma_channel_read(LitexDMAChannel *ch, unsigned reg)
+{
+    if (reg >= LITEX_DMA_OFFSET0 && reg < LITEX_DMA_OFFSET0 + 4) {
+        return (ch->offset >> (8 * (LITEX_DMA_OFFSET0 + 3 - reg))) & 0xff;
+    }
+    return ch->regs[reg];
+}
+
+bool litex_dma_channel_write(LitexDMAChannel *ch, unsigned reg,
+                             uint32_t value)
+{
+    bool start = false;
+
+    value &= 0xff;
+
+    switch (reg) {
+    case LITEX_DMA_ENABLE:
+        /* a new transfer starts on every rising edge, disabling aborts */
+        start = (value & 1) && !ch->regs[reg];
+        ch->regs[LITEX_DMA_DONE] = 0;
+        ch->offset = 0;
+        ch->regs[reg] = value & 1;
+        break;
+    case LITEX_DMA_DONE:
+    case LITEX_DMA_OFFSET0 ... LITEX_DMA_OFFSET0 + 3:
+        /* read-only */
+        break;
+    default:
+        ch->regs[reg] = value;
+        break;
+    }
+
+    return start;
+}
+
+bool litex_dma_channel_active(LitexDMAChannel *ch)
+{
+    return ch->regs[LITEX_DMA_ENABLE] && !ch->regs[LITEX_DMA_DONE] &&
+           dma_get_reg32(ch, LITEX_DMA_LENGTH0);
+}
+
+hwaddr litex_dma_channel_addr(LitexDMAChannel *ch)
+{
+    uint64_t base = ((uint64_t)dma_get_reg32(ch, LITEX_DMA_BASE0) << 32) |
+                    dma_get_reg32(ch, LITEX_DMA_BASE0 + 4);
+
+    return base + ch->offset;
+}
+
+uint32_t litex_dma_channel_remaining(LitexDMAChannel *ch)
+{
+    uint32_t length = dma_get_reg32(ch, LITEX_DMA_LENGTH0);
+
+    return length > ch->offset ? length - ch->offset : 0;
+}
+
+bool litex_dma_channel_advance(LitexDMAChannel *ch, uint32_t len)
+{
+    ch->offset += len;
+    if (ch->offset < dma_get_reg32(ch, LITEX_DMA_LENGTH0)) {
+        return false;
+    }
+    if (ch->regs[LITEX_DMA_LOOP]) {
+        ch->offset = 0;
+        return false;
+    }
+    ch->regs[LITEX_DMA_DONE] = 1;
+    return true;
+}
+
+const VMStateDescription vmstate_litex_dma_channel = {
+    .name = "litex-dma-channel",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8_ARRAY(regs, LitexDMAChannel, LITEX_DMA_R_MAX),
+        VMSTATE_UINT32(offset, LitexDMAChannel),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+/* the memory to memory engine */
+
+enum {
+    R_READER = 0,
+    R_WRITER = R_READER + LITEX_DMA_R_MAX,
+    R_EV_STATUS = R_WRITER + LITEX_DMA_R_MAX,
+    R_EV_PENDING,
+    R_EV_ENABLE,
+    R_MAX
+};
+
+#define DMA_EV_READER_DONE  1
+#define DMA_EV_WRITER_DONE  2
+
+/* bytes per address_space_rw() call, and per timer run when unpaced */
+#define DMA_CHUNK           65536
+#define DMA_BURST           (16 * DMA_CHUNK)
+
+#define TYPE_LITEX_DMA "litex-dma"
+#define LITEX_DMA(obj) OBJECT_CHECK(LitexDMAState, (obj), TYPE_LITEX_DMA)
+
+struct LitexDMAState {
+    SysBusDevice parent_obj;
+
+    MemoryRegion regs_region;
+    AddressSpace *as;
+    QEMUTimer *timer;
+
+    LitexDMAChannel reader;
+    LitexDMAChannel writer;
+    uint8_t ev_pending;
+    uint8_t ev_enable;
+
+    uint32_t bandwidth;         /* bytes per second, 0 for unpaced */
+    uint32_t inflight;          /* paced chunk completing at the next run */
+    uint8_t *buf;
+
+    qemu_irq irq;
+};
+typedef struct LitexDMAState LitexDMAState;
+
+static void dma_update_irq(LitexDMAState *s)
+{
+    qemu_set_irq(s->irq, s->ev_pending & s->ev_enable);
+}
+
+static bool dma_active(LitexDMAState *s)
+{
+    return litex_dma_channel_active(&s->reader) &&
+           litex_dma_channel_active(&s->writer);
+}
+
+static void dma_stop(LitexDMAState *s)
+{
+    timer_del(s->timer);
+    s->inflight = 0;
+}
+
+static void dma_kick(LitexDMAState *s)
+{
+    if (dma_active(s) && !timer_pending(s->timer)) {
+        timer_mod(s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+    }
+}
+
+/* Copy the next chunk, without advancing the channels.  */
+static uint32_t dma_copy_chunk(LitexDMAState *s)
+{
+    uint32_t len;
+
+    len = MIN(litex_dma_channel_remaining(&s->reader),
+              litex_dma_channel_remaining(&s->writer));
+    len = MIN(len, DMA_CHUNK);
+
+    trace_litex_dma_transfer(litex_dma_channel_addr(&s->reader),
+                             litex_dma_channel_addr(&s->writer), len);
+    address_space_rw(s->as, litex_dma_channel_addr(&s->reader),
+                     MEMTXATTRS_UNSPECIFIED, s->buf, len, false);
+    address_space_rw(s->as, litex_dma_channel_addr(&s->writer),
+                     MEMTXATTRS_UNSPECIFIED, s->buf, len, true);
+    return len;
+}
+
+static void dma_complete_chunk(LitexDMAState *s, uint32_t len)
+{
+    if (litex_dma_channel_advance(&s->reader, len)) {
+        s->ev_pending |= DMA_EV_READER_DONE;
+    }
+    if (litex_dma_channel_advance(&s->writer, len)) {
+        s->ev_pending |= DMA_EV_WRITER_DONE;
+    }
+}
+
+static void dma_run(void *opaque)
+{
+    LitexDMAState *s = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    uint32_t moved = 0;
+    uint32_t len;
+
+    if (s->bandwidth) {
+        /* the chunk copied by the previous run has taken its time */
+        if (s->inflight) {
+            dma_complete_chunk(s, s->inflight);
+            s->inflight = 0;
+        }
+        if (dma_active(s)) {
+            s->inflight = dma_copy_chunk(s);
+            timer_mod(s->timer, now + muldiv64(s->inflight,
+                                               NANOSECONDS_PER_SECOND,
+                                               s->bandwidth));
+        }
+    } else {
+        while (dma_active(s)) {
+            if (moved >= DMA_BURST) {
+                timer_mod(s->timer, now);
+                break;
+            }
+            len = dma_copy_chunk(s);
+            dma_complete_chunk(s, len);
+            moved += len;
+        }
+    }
+
+    dma_update_irq(s);
+}
+
+static uint64_t dma_read(void *opaque, hwaddr addr, unsigned size)
+{
+    LitexDMAState *s = opaque;
+    uint32_t r = 0;
+
+    addr >>= 2;
+    switch (addr) {
+    case R_READER ... R_READER + LITEX_DMA_R_MAX - 1:
+        r = litex_dma_channel_read(&s->reader, addr - R_READER);
+        break;
+    case R_WRITER ... R_WRITER + LITEX_DMA_R_MAX - 1:
+        r = litex_dma_channel_read(&s->writer, addr - R_WRITER);
+        break;
+    case R_EV_STATUS:
+        r = (s->reader.regs[LITEX_DMA_DONE] ? DMA_EV_READER_DONE : 0) |
+            (s->writer.regs[LITEX_DMA_DONE] ? DMA_EV_WRITER_DONE : 0);
+        break;
+    case R_EV_PENDING:
+        r = s->ev_pending;
+        break;
+    case R_EV_ENABLE:
+        r = s->ev_enable;
+        break;
+
+    default:
+        error_report("litex_dma: read access to unknown register 0x"
+                TARGET_FMT_plx, addr << 2);
+        break;
+    }
+
+    return r;
+}
+
+static void dma_write(void *opaque, hwaddr addr, uint64_t value,
+                      unsigned size)
+{
+    LitexDMAState *s = opaque;
+
+    value &= 0xff;
+
+    addr >>= 2;
+    switch (addr) {
+    case R_READER ... R_READER + LITEX_DMA_R_MAX - 1:
+        if (litex_dma_channel_write(&s->reader, addr - R_READER, value)) {
+            dma_kick(s);
+        }
+        break;
+    case R_WRITER ... R_WRITER + LITEX_DMA_R_MAX - 1:
+        if (litex_dma_channel_write(&s->writer, addr - R_WRITER, value)) {
+            dma_kick(s);
+        }
+        break;
+    case R_EV_PENDING:
+        /* write one to clear */
+        s->ev_pending &= ~value;
+        dma_update_irq(s);
+        break;
+    case R_EV_ENABLE:
+        s->ev_enable = value;
+        dma_update_irq(s);
+        break;
+    case R_EV_STATUS:
+        break;
+
+    default:
+        error_report("litex_dma: write access to unknown register 0x"
+                TARGET_FMT_plx, addr << 2);
+        break;
+    }
+
+    if (!dma_active(s)) {
+        dma_stop(s);
+    }
+}
+
+static const MemoryRegionOps dma_mmio_ops = {
+    .read = dma_read,
+    .write = dma_write,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static void litex_dma_reset(DeviceState *d)
+{
+    LitexDMAState *s = LITEX_DMA(d);
+
+    litex_dma_channel_reset(&s->reader);
+    litex_dma_channel_reset(&s->writer);
+    s->ev_pending = 0;
+    s->ev_enable = 0;
+    dma_stop(s);
+}
+
+static int litex_dma_post_load(void *opaque, int version_id)
+{
+    LitexDMAState *s = opaque;
+
+    /* a chunk in flight was not completed, copy it again */
+    dma_stop(s);
+    dma_kick(s);
+    return 0;
+}
+
+static void litex_dma_realize(DeviceState *dev, Error **errp)
+{
+    LitexDMAState *s = LITEX_DMA(dev);
+
+    s->as = &address_space_memory;
+    s->buf = g_malloc(DMA_CHUNK);
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, dma_run, s);
+}
+
+static void litex_dma_init(Object *obj)
+{
+    LitexDMAState *s = LITEX_DMA(obj);
+    SysBusDevice *dev = SYS_BUS_DEVICE(obj);
+
+    sysbus_init_irq(dev, &s->irq);
+
+    memory_region_init_io(&s->regs_region, obj, &dma_mmio_ops, s,
+            "litex-dma", R_MAX * 4);
+    sysbus_init_mmio(dev, &s->regs_region);
+}
+
+static const VMStateDescription vmstate_litex_dma = {
+    .name = "litex-dma",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = litex_dma_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT(reader, LitexDMAState, 1, vmstate_litex_dma_channel,
+                       LitexDMAChannel),
+        VMSTATE_STRUCT(writer, LitexDMAState, 1, vmstate_litex_dma_channel,
+                       LitexDMAChannel),
+        VMSTATE_UINT8(ev_pending, LitexDMAState),
+        VMSTATE_UINT8(ev_enable, LitexDMAState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property litex_dma_properties[] = {
+    DEFINE_PROP_UINT32("bandwidth", LitexDMAState, bandwidth, 0),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void litex_dma_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = litex_dma_realize;
+    dc->reset = litex_dma_reset;
+    dc->vmsd = &vmstate_litex_dma;
+    dc->props = litex_dma_properties;
+}
+
+static const TypeInfo litex_dma_info = {
+    .name          = TYPE_LITEX_DMA,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(LitexDMAState),
+    .instance_init = litex_dma_init,
+    .class_init    = litex_dma_class_init,
+};
+
+static void litex_dma_register_types(void)
+{
+    type_register_static(&litex_dma_info);
+}
+
+type_init(litex_dma_register_types)
@@ -0,0 +1,345 @@
+/*
+ *  QEMU model of the LiteX GPIOOut/GPIOIn blocks (LEDs, switches, ...).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Every CSR is ngpio bits wide, split over (ngpio + 7) / 8 byte registers,
+ * most significant byte first.  An output block has
+ *
+ *   OUT             pin levels
+ *
+ * and an input block
+ *
+ *   IN              pin levels
+ *   MODE            per pin: 0 interrupt on an edge, 1 on any change
+ *   EDGE            per pin: 0 rising, 1 falling
+ *   EV_STATUS       same as IN
+ *   EV_PENDING      write one to clear
+ *   EV_ENABLE
+ *
+ * The pins are qdev GPIOs, and the "state" property reads the levels and,
+ * for inputs, sets them.  Changes of the outputs are reported with the
+ * LITEX_GPIO_CHANGE QMP event; the monitor throttles it per device, so a
+ * guest toggling LEDs in a loop produces a bounded stream of events that
+ * always ends with the current state.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/hw.h"
+#include "hw/sysbus.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "qapi-event.h"
+#include "qemu/error-report.h"
+
+enum {
+    R_OUT = 0,
+    R_OUT_MAX
+};
+
+enum {
+    R_IN = 0,
+    R_MODE,
+    R_EDGE,
+    R_EV_STATUS,
+    R_EV_PENDING,
+    R_EV_ENABLE,
+    R_IN_MAX
+};
+
+#define LITEX_GPIO_MAX 32
+
+#define TYPE_LITEX_GPIO "litex-gpio"
+#define LITEX_GPIO(obj) OBJECT_CHECK(LitexGPIOState, (obj), TYPE_LITEX_GPIO)
+
+struct LitexGPIOState {
+    SysBusDevice parent_obj;
+
+    MemoryRegion regs_region;
+
+    uint32_t ngpio;
+    bool input;
+    unsigned nbytes;
+    uint32_t mask;
+
+    uint32_t out;
+    uint32_t in;
+    uint32_t mode;
+    uint32_t edge;
+    uint32_t pending;
+    uint32_t enable;
+
+    qemu_irq irq;
+    qemu_irq pins[LITEX_GPIO_MAX];
+};
+typedef struct LitexGPIOState LitexGPIOState;
+
+static void gpio_update_irq(LitexGPIOState *s)
+{
+    qemu_set_irq(s->irq, (s->pending & s->enable) != 0);
+}
+
+static void gpio_set_out(LitexGPIOState *s, uint32_t value)
+{
+    uint32_t changed = (s->out ^ value) & s->mask;
+    char *path;
+    int i;
+
+    if (!changed) {
+        return;
+    }
+    s->out = value & s->mask;
+
+    for (i = 0; i < s->ngpio; i++) {
+        if (changed & (1u << i)) {
+            qemu_set_irq(s->pins[i], (s->out >> i) & 1);
+        }
+    }
+
+    path = object_get_canonical_path(OBJECT(s));
+    qapi_event_send_litex_gpio_change(path, s->out, &error_abort);
+    g_free(path);
+}
+
+static void gpio_set_in(LitexGPIOState *s, uint32_t value)
+{
+    uint32_t changed = (s->in ^ value) & s->mask;
+    uint32_t rising = changed & value;
+    uint32_t falling = changed & ~value;
+
+    s->in = value & s->mask;
+    s->pending |= (changed & s->mode) |
+                  (rising & ~s->mode & ~s->edge) |
+                  (falling & ~s->mode & s->edge);
+    gpio_update_irq(s);
+}
+
+static uint32_t *gpio_reg(LitexGPIOState *s, unsigned reg)
+{
+    if (!s->input) {
+        return reg == R_OUT ? &s->out : NULL;
+    }
+
+    switch (reg) {
+    case R_IN:
+    case R_EV_STATUS:
+        return &s->in;
+    case R_MODE:
+        return &s->mode;
+    case R_EDGE:
+        return &s->edge;
+    case R_EV_PENDING:
+        return &s->pending;
+    case R_EV_ENABLE:
+        return &s->enable;
+    }
+    return NULL;
+}
+
+static uint64_t gpio_read(void *opaque, hwaddr addr, unsigned size)
+{
+    LitexGPIOState *s = opaque;
+    unsigned reg, shift;
+    uint32_t *p;
+
+    addr >>= 2;
+    reg = addr / s->nbytes;
+    shift = 8 * (s->nbytes - 1 - addr % s->nbytes);
+    p = gpio_reg(s, reg);
+    if (!p) {
+        error_report("litex_gpio: read access to unknown register 0x"
+                TARGET_FMT_plx, addr << 2);
+        return 0;
+    }
+
+    return (*p >> shift) & 0xff;
+}
+
+static void gpio_write(void *opaque, hwaddr addr, uint64_t value,
+                       unsigned size)
+{
+    LitexGPIOState *s = opaque;
+    unsigned reg, shift;
+    uint32_t *p, v;
+
+    addr >>= 2;
+    reg = addr / s->nbytes;
+    shift = 8 * (s->nbytes - 1 - addr % s->nbytes);
+    p = gpio_reg(s, reg);
+    if (!p) {
+        error_report("litex_gpio: write access to unknown register 0x"
+                TARGET_FMT_plx, addr << 2);
+        return;
+    }
+
+    value = (value & 0xff) << shift;
+    v = ((*p & ~(0xffu << shift)) | value) & s->mask;
+
+    if (!s->input) {
+        gpio_set_out(s, v);
+        return;
+    }
+
+    switch (reg) {
+    case R_MODE:
+    case R_EDGE:
+    case R_EV_ENABLE:
+        *p = v;
+        gpio_update_irq(s);
+        break;
+    case R_EV_PENDING:
+        s->pending &= ~value;
+        gpio_update_irq(s);
+        break;
+    default:
+        /* IN and EV_STATUS are read-only */
+        break;
+    }
+}
+
+static const MemoryRegionOps gpio_mmio_ops = {
+    .read = gpio_read,
+    .write = gpio_write,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static void gpio_input_handler(void *opaque, int n, int level)
+{
+    LitexGPIOState *s = opaque;
+
+    gpio_set_in(s, deposit32(s->in, n, 1, level != 0));
+}
+
+static void gpio_get_state(Object *obj, Visitor *v, const char *name,
+                           void *opaque, Error **errp)
+{
+    LitexGPIOState *s = LITEX_GPIO(obj);
+    uint32_t value = s->input ? s->in : s->out;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void gpio_set_state(Object *obj, Visitor *v, const char *name,
+                           void *opaque, Error **errp)
+{
+    LitexGPIOState *s = LITEX_GPIO(obj);
+    Error *local_err = NULL;
+    uint32_t value;
+
+    visit_type_uint32(v, name, &value, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+    if (!s->input) {
+        error_setg(errp, "the state of an output block is set by the guest");
+        return;
+    }
+
+    gpio_set_in(s, value);
+}
+
+static void litex_gpio_reset(DeviceState *d)
+{
+    LitexGPIOState *s = LITEX_GPIO(d);
+
+    /* inputs keep their level across a reset, they are driven from outside */
+    gpio_set_out(s, 0);
+    s->mode = 0;
+    s->edge = 0;
+    s->pending = 0;
+    s->enable = 0;
+}
+
+static void litex_gpio_init(Object *obj)
+{
+    object_property_add(obj, "state", "uint32",
+                        gpio_get_state, gpio_set_state, NULL, NULL, NULL);
+}
+
+static void litex_gpio_realize(DeviceState *dev, Error **errp)
+{
+    LitexGPIOState *s = LITEX_GPIO(dev);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
+
+    if (s->ngpio < 1 || s->ngpio > LITEX_GPIO_MAX) {
+        error_setg(errp, "ngpio must be between 1 and %d", LITEX_GPIO_MAX);
+        return;
+    }
+    s->nbytes = (s->ngpio + 7) / 8;
+    s->mask = s->ngpio == 32 ? ~0u : (1u << s->ngpio) - 1;
+
+    memory_region_init_io(&s->regs_region, OBJECT(dev), &gpio_mmio_ops, s,
+                          "litex-gpio",
+                          4 * s->nbytes * (s->input ? R_IN_MAX : R_OUT_MAX));
+    sysbus_init_mmio(sbd, &s->regs_region);
+
+    if (s->input) {
+        sysbus_init_irq(sbd, &s->irq);
+        qdev_init_gpio_in(dev, gpio_input_handler, s->ngpio);
+    } else {
+        qdev_init_gpio_out(dev, s->pins, s->ngpio);
+    }
+}
+
+static const VMStateDescription vmstate_litex_gpio = {
+    .name = "litex-gpio",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(out, LitexGPIOState),
+        VMSTATE_UINT32(in, LitexGPIOState),
+        VMSTATE_UINT32(mode, LitexGPIOState),
+        VMSTATE_UINT32(edge, LitexGPIOState),
+        VMSTATE_UINT32(pending, LitexGPIOState),
+        VMSTATE_UINT32(enable, LitexGPIOState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property litex_gpio_properties[] = {
+    DEFINE_PROP_UINT32("ngpio", LitexGPIOState, ngpio, 8),
+    DEFINE_PROP_BOOL("input", LitexGPIOState, input, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void litex_gpio_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = litex_gpio_realize;
+    dc->reset = litex_gpio_reset;
+    dc->vmsd = &vmstate_litex_gpio;
+    dc->props = litex_gpio_properties;
+}
+
+static const TypeInfo litex_gpio_info = {
+    .name          = TYPE_LITEX_GPIO,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(LitexGPIOState),
+    .instance_init = litex_gpio_init,
+    .class_init    = litex_gpio_class_init,
+};
+
+static void litex_gpio_register_types(void)
+{
+    type_register_static(&litex_gpio_info);
+}
+
+type_init(litex_gpio_register_types)
@@ -23,8 +23,12 @@
 #include "hw/i386/pc.h"
 #include "monitor/monitor.h"
 #include "hw/sysbus.h"
+#include "qemu/host-utils.h"
+#include "qemu/timer.h"
+#include "qmp-commands.h"
 #include "trace.h"
 #include "hw/lm32/litex_pic.h"
+#include "hw/lm32/lm32_pic.h"
 #include "hw/intc/intc.h"
 
 #define TYPE_LITEX_PIC "litex-pic"
@@ -37,21 +41,64 @@ struct LITEXPicState {
     uint32_t im;        /* interrupt mask */
     uint32_t ip;        /* interrupt pending */
     uint32_t irq_state;
+    bool parent_level;  /* last level driven on parent_irq */
 
     /* statistics */
     uint64_t stats_irq_count[32];
+    uint64_t stats_latency[32][LITEX_PIC_LATENCY_BUCKETS];
+    uint64_t stats_parent_raise;
+    uint64_t stats_parent_lower;
+    uint32_t latency_pending;   /* inputs with a valid raise_ns */
+    int64_t raise_ns[32];       /* QEMU_CLOCK_VIRTUAL time of last raise */
 };
 typedef struct LITEXPicState LITEXPicState;
 
+/*
+ * Latency from an input being raised to it being lowered by the device or
+ * acked by the guest, in virtual time.  Bucket 0 counts everything below
+ * 2us, bucket n latencies in [2^n, 2^(n+1)) us; the last bucket also takes
+ * everything longer.
+ */
+static void latency_account(LITEXPicState *s, uint32_t irqs)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    uint64_t us;
+    int irq, bucket;
+
+    irqs &= s->latency_pending;
+    s->latency_pending &= ~irqs;
+
+    while (irqs) {
+        irq = ctz32(irqs);
+        irqs &= irqs - 1;
+
+        us = (now - s->raise_ns[irq]) / SCALE_US;
+        bucket = us < 2 ? 0 : MIN(63 - clz64(us),
+                                  LITEX_PIC_LATENCY_BUCKETS - 1);
+        s->stats_latency[irq][bucket]++;
+    }
+}
+
 static void update_irq(LITEXPicState *s)
 {
+    bool level;
 
     s->ip = s->irq_state;
-    if (s->ip & s->im) {
+    level = (s->ip & s->im) != 0;
+
+    /* only signal edges, every call ends up in cpu_(reset_)interrupt() */
+    if (level == s->parent_level) {
+        return;
+    }
+    s->parent_level = level;
+
+    if (level) {
         trace_litex_pic_raise_irq();
+        s->stats_parent_raise++;
         qemu_irq_raise(s->parent_irq);
     } else {
         trace_litex_pic_lower_irq();
+        s->stats_parent_lower++;
         qemu_irq_lower(s->parent_irq);
     }
 }
@@ -66,8 +113,13 @@ static void irq_handler(void *opaque, int irq, int level)
     if (level) {
         s->irq_state |= (1 << irq);
         s->stats_irq_count[irq]++;
+        if (!(s->latency_pending & (1 << irq))) {
+            s->latency_pending |= 1 << irq;
+            s->raise_ns[irq] = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        }
     } else {
         s->irq_state &= ~(1 << irq);
+        latency_account(s, 1 << irq);
     }
 
     update_irq(s);
@@ -91,6 +143,7 @@ void litex_pic_set_ip(DeviceState *d, uint32_t ip)
 
     /* ack interrupt */
     s->ip &= ~ip;
+    latency_account(s, ip);
 
     update_irq(s);
 }
@@ -119,9 +172,14 @@ static void pic_reset(DeviceState *d)
     s->im = 0;
     s->ip = 0;
     s->irq_state = 0;
+    s->parent_level = false;
     for (i = 0; i < 32; i++) {
         s->stats_irq_count[i] = 0;
     }
+    memset(s->stats_latency, 0, sizeof(s->stats_latency));
+    s->stats_parent_raise = 0;
+    s->stats_parent_lower = 0;
+    s->latency_pending = 0;
 }
 
 static bool litex_get_statistics(InterruptStatsProvider *obj,
@@ -140,6 +198,62 @@ static void litex_print_info(InterruptStatsProvider *obj, Monitor *mon)
             s->im, s->ip, s->irq_state);
 }
 
+static int query_litex_pic_foreach(Object *obj, void *opaque)
+{
+    LitexPicInfoList **list = opaque;
+    LitexPicInfoList *entry;
+    LitexPicInfo *info;
+    LITEXPicState *s;
+    int i, j;
+
+    if (!object_dynamic_cast(obj, TYPE_LITEX_PIC)) {
+        return 0;
+    }
+    s = LITEX_PIC(obj);
+
+    info = g_new0(LitexPicInfo, 1);
+    info->path = object_get_canonical_path(obj);
+    info->parent_raises = s->stats_parent_raise;
+    info->parent_lowers = s->stats_parent_lower;
+
+    for (i = 31; i >= 0; i--) {
+        LitexPicIrqStatsList *irq;
+
+        if (!s->stats_irq_count[i]) {
+            continue;
+        }
+        irq = g_new0(LitexPicIrqStatsList, 1);
+        irq->value = g_new0(LitexPicIrqStats, 1);
+        irq->value->irq = i;
+        irq->value->count = s->stats_irq_count[i];
+        for (j = LITEX_PIC_LATENCY_BUCKETS - 1; j >= 0; j--) {
+            intList *bucket = g_new0(intList, 1);
+
+            bucket->value = s->stats_latency[i][j];
+            bucket->next = irq->value->latency;
+            irq->value->latency = bucket;
+        }
+        irq->next = info->irqs;
+        info->irqs = irq;
+    }
+
+    entry = g_new0(LitexPicInfoList, 1);
+    entry->value = info;
+    entry->next = *list;
+    *list = entry;
+
+    return 0;
+}
+
+LitexPicInfoList *qmp_query_litex_pic(Error **errp)
+{
+    LitexPicInfoList *list = NULL;
+
+    object_child_foreach_recursive(object_get_root(),
+                                   query_litex_pic_foreach, &list);
+    return list;
+}
+
 static void litex_pic_init(Object *obj)
 {
     DeviceState *dev = DEVICE(obj);
@@ -150,15 +264,31 @@ static void litex_pic_init(Object *obj)
     sysbus_init_irq(sbd, &s->parent_irq);
 }
 
+static int litex_pic_post_load(void *opaque, int version_id)
+{
+    LITEXPicState *s = opaque;
+
+    /* the CPU side of the line is migrated with the CPU */
+    s->parent_level = (s->ip & s->im) != 0;
+    return 0;
+}
+
 static const VMStateDescription vmstate_litex_pic = {
     .name = "litex-pic",
-    .version_id = 2,
+    .version_id = 3,
     .minimum_version_id = 2,
+    .post_load = litex_pic_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32(im, LITEXPicState),
         VMSTATE_UINT32(ip, LITEXPicState),
         VMSTATE_UINT32(irq_state, LITEXPicState),
         VMSTATE_UINT64_ARRAY(stats_irq_count, LITEXPicState, 32),
+        VMSTATE_UINT64_2DARRAY_V(stats_latency, LITEXPicState, 32,
+                                 LITEX_PIC_LATENCY_BUCKETS, 3),
+        VMSTATE_UINT64_V(stats_parent_raise, LITEXPicState, 3),
+        VMSTATE_UINT64_V(stats_parent_lower, LITEXPicState, 3),
+        VMSTATE_UINT32_V(latency_pending, LITEXPicState, 3),
+        VMSTATE_INT64_ARRAY_V(raise_ns, LITEXPicState, 32, 3),
         VMSTATE_END_OF_LIST()
     }
 };
@@ -167,11 +297,16 @@ static void litex_pic_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
     InterruptStatsProviderClass *ic = INTERRUPT_STATS_PROVIDER_CLASS(klass);
+    LM32PicInterfaceClass *pc = LM32_PIC_INTERFACE_CLASS(klass);
 
     dc->reset = pic_reset;
     dc->vmsd = &vmstate_litex_pic;
     ic->get_statistics = litex_get_statistics;
     ic->print_info = litex_print_info;
+    pc->get_ip = litex_pic_get_ip;
+    pc->get_im = litex_pic_get_im;
+    pc->set_ip = litex_pic_set_ip;
+    pc->set_im = litex_pic_set_im;
 }
 
 static const TypeInfo litex_pic_info = {
@@ -182,6 +317,7 @@ static const TypeInfo litex_pic_info = {
     .class_init    = litex_pic_class_init,
     .interfaces = (InterfaceInfo[]) {
         { TYPE_INTERRUPT_STATS_PROVIDER },
+        { TYPE_LM32_PIC_INTERFACE },
         { }
     },
 };
@@ -74,7 +74,7 @@ static void irq_handler(void *opaque, int irq, int level)
     update_irq(s);
 }
 
-void lm32_pic_set_im(DeviceState *d, uint32_t im)
+static void pic_set_im(DeviceState *d, uint32_t im)
 {
     LM32PicState *s = LM32_PIC(d);
 
@@ -84,7 +84,7 @@ void lm32_pic_set_im(DeviceState *d, uint32_t im)
     update_irq(s);
 }
 
-void lm32_pic_set_ip(DeviceState *d, uint32_t ip)
+static void pic_set_ip(DeviceState *d, uint32_t ip)
 {
     LM32PicState *s = LM32_PIC(d);
 
@@ -96,7 +96,7 @@ void lm32_pic_set_ip(DeviceState *d, uint32_t ip)
     update_irq(s);
 }
 
-uint32_t lm32_pic_get_im(DeviceState *d)
+static uint32_t pic_get_im(DeviceState *d)
 {
     LM32PicState *s = LM32_PIC(d);
 
@@ -104,7 +104,7 @@ uint32_t lm32_pic_get_im(DeviceState *d)
     return s->im;
 }
 
-uint32_t lm32_pic_get_ip(DeviceState *d)
+static uint32_t pic_get_ip(DeviceState *d)
 {
     LM32PicState *s = LM32_PIC(d);
 
@@ -112,6 +112,26 @@ uint32_t lm32_pic_get_ip(DeviceState *d)
     return s->ip;
 }
 
+void lm32_pic_set_im(DeviceState *d, uint32_t im)
+{
+    LM32_PIC_INTERFACE_GET_CLASS(d)->set_im(d, im);
+}
+
+void lm32_pic_set_ip(DeviceState *d, uint32_t ip)
+{
+    LM32_PIC_INTERFACE_GET_CLASS(d)->set_ip(d, ip);
+}
+
+uint32_t lm32_pic_get_im(DeviceState *d)
+{
+    return LM32_PIC_INTERFACE_GET_CLASS(d)->get_im(d);
+}
+
+uint32_t lm32_pic_get_ip(DeviceState *d)
+{
+    return LM32_PIC_INTERFACE_GET_CLASS(d)->get_ip(d);
+}
+
 static void pic_reset(DeviceState *d)
 {
     LM32PicState *s = LM32_PIC(d);
@@ -168,11 +188,16 @@ static void lm32_pic_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
     InterruptStatsProviderClass *ic = INTERRUPT_STATS_PROVIDER_CLASS(klass);
+    LM32PicInterfaceClass *pc = LM32_PIC_INTERFACE_CLASS(klass);
 
     dc->reset = pic_reset;
     dc->vmsd = &vmstate_lm32_pic;
     ic->get_statistics = lm32_get_statistics;
     ic->print_info = lm32_print_info;
+    pc->get_ip = pic_get_ip;
+    pc->get_im = pic_get_im;
+    pc->set_ip = pic_set_ip;
+    pc->set_im = pic_set_im;
 }
 
 static const TypeInfo lm32_pic_info = {
@@ -183,12 +208,20 @@ static const TypeInfo lm32_pic_info = {
     .class_init    = lm32_pic_class_init,
     .interfaces = (InterfaceInfo[]) {
         { TYPE_INTERRUPT_STATS_PROVIDER },
+        { TYPE_LM32_PIC_INTERFACE },
         { }
     },
 };
 
+static const TypeInfo lm32_pic_interface_info = {
+    .name          = TYPE_LM32_PIC_INTERFACE,
+    .parent        = TYPE_INTERFACE,
+    .class_size    = sizeof(LM32PicInterfaceClass),
+};
+
 static void lm32_pic_register_types(void)
 {
+    type_register_static(&lm32_pic_interface_info);
     type_register_static(&lm32_pic_info);
 }
 
@@ -0,0 +1,247 @@
+/*
+ *  LiteX SoC description (csr.json) parser.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qjson.h"
+#include "qapi/qmp/qint.h"
+#include "exec/hwaddr.h"
+#include "litex-csr.h"
+#include "generated/csr.h"
+#include "generated/mem.h"
+
+LitexCsr *litex_csr_load(const char *filename, Error **errp)
+{
+    LitexCsr *csr;
+    QObject *obj;
+    QDict *root;
+    gchar *contents;
+    GError *gerr = NULL;
+
+    if (!g_file_get_contents(filename, &contents, NULL, &gerr)) {
+        error_setg(errp, "could not read '%s': %s", filename, gerr->message);
+        g_error_free(gerr);
+        return NULL;
+    }
+
+    obj = qobject_from_json(contents);
+    g_free(contents);
+
+    root = qobject_to_qdict(obj);
+    if (!root) {
+        error_setg(errp, "'%s' is not a valid LiteX csr.json file", filename);
+        qobject_decref(obj);
+        return NULL;
+    }
+
+    csr = g_new0(LitexCsr, 1);
+    csr->root = root;
+    return csr;
+}
+
+static void builtin_add_memory(QDict *memories, const char *name,
+                               hwaddr base, uint64_t size)
+{
+    QDict *mem = qdict_new();
+
+    qdict_put(mem, "base", qint_from_int(base));
+    qdict_put(mem, "size", qint_from_int(size));
+    qdict_put(memories, name, mem);
+}
+
+/* Describe the SoC the binary was built against (include/generated). */
+LitexCsr *litex_csr_builtin(void)
+{
+    LitexCsr *csr = g_new0(LitexCsr, 1);
+    QDict *bases = qdict_new();
+    QDict *constants = qdict_new();
+    QDict *memories = qdict_new();
+
+#ifdef CSR_UART_BASE
+    qdict_put(bases, "uart", qint_from_int(CSR_UART_BASE));
+#endif
+#ifdef CSR_UART16550_BASE
+    qdict_put(bases, "uart16550", qint_from_int(CSR_UART16550_BASE));
+#endif
+#ifdef CSR_TIMER0_BASE
+    qdict_put(bases, "timer0", qint_from_int(CSR_TIMER0_BASE));
+#endif
+#ifdef CSR_SPIFLASH_BASE
+    qdict_put(bases, "spiflash", qint_from_int(CSR_SPIFLASH_BASE));
+#endif
+#ifdef CSR_ETHMAC_BASE
+    qdict_put(bases, "ethmac", qint_from_int(CSR_ETHMAC_BASE));
+#endif
+#ifdef CSR_MAILBOX_BASE
+    qdict_put(bases, "mailbox", qint_from_int(CSR_MAILBOX_BASE));
+#endif
+#ifdef CSR_DMA_BASE
+    qdict_put(bases, "dma", qint_from_int(CSR_DMA_BASE));
+#endif
+#ifdef CSR_VIDEO_FRAMEBUFFER_BASE
+    qdict_put(bases, "video_framebuffer",
+              qint_from_int(CSR_VIDEO_FRAMEBUFFER_BASE));
+    qdict_put(bases, "video_framebuffer_vtg",
+              qint_from_int(CSR_VIDEO_FRAMEBUFFER_VTG_BASE));
+#endif
+#ifdef CSR_LEDS_BASE
+    qdict_put(bases, "leds", qint_from_int(CSR_LEDS_BASE));
+#endif
+#ifdef CSR_SWITCHES_BASE
+    qdict_put(bases, "switches", qint_from_int(CSR_SWITCHES_BASE));
+#endif
+#ifdef CSR_BUTTONS_BASE
+    qdict_put(bases, "buttons", qint_from_int(CSR_BUTTONS_BASE));
+#endif
+#ifdef CSR_GPIO_OUT_BASE
+    qdict_put(bases, "gpio_out", qint_from_int(CSR_GPIO_OUT_BASE));
+#endif
+#ifdef CSR_GPIO_IN_BASE
+    qdict_put(bases, "gpio_in", qint_from_int(CSR_GPIO_IN_BASE));
+#endif
+#ifdef CSR_SDCORE_BASE
+    qdict_put(bases, "sdphy", qint_from_int(CSR_SDPHY_BASE));
+    qdict_put(bases, "sdcore", qint_from_int(CSR_SDCORE_BASE));
+    qdict_put(bases, "sdblock2mem", qint_from_int(CSR_SDBLOCK2MEM_BASE));
+    qdict_put(bases, "sdmem2block", qint_from_int(CSR_SDMEM2BLOCK_BASE));
+    qdict_put(bases, "sdirq", qint_from_int(CSR_SDIRQ_BASE));
+#endif
+
+#ifdef UART_INTERRUPT
+    qdict_put(constants, "uart_interrupt", qint_from_int(UART_INTERRUPT));
+#endif
+#ifdef TIMER0_INTERRUPT
+    qdict_put(constants, "timer0_interrupt", qint_from_int(TIMER0_INTERRUPT));
+#endif
+#ifdef ETHMAC_INTERRUPT
+    qdict_put(constants, "ethmac_interrupt", qint_from_int(ETHMAC_INTERRUPT));
+#endif
+#ifdef MAILBOX_INTERRUPT
+    qdict_put(constants, "mailbox_interrupt", qint_from_int(MAILBOX_INTERRUPT));
+#endif
+#ifdef DMA_INTERRUPT
+    qdict_put(constants, "dma_interrupt", qint_from_int(DMA_INTERRUPT));
+#endif
+#ifdef SDCARD_INTERRUPT
+    qdict_put(constants, "sdcard_interrupt", qint_from_int(SDCARD_INTERRUPT));
+#endif
+#ifdef VIDEO_FRAMEBUFFER_DEPTH
+    qdict_put(constants, "video_framebuffer_depth",
+              qint_from_int(VIDEO_FRAMEBUFFER_DEPTH));
+#endif
+#ifdef SWITCHES_INTERRUPT
+    qdict_put(constants, "switches_interrupt",
+              qint_from_int(SWITCHES_INTERRUPT));
+#endif
+#ifdef BUTTONS_INTERRUPT
+    qdict_put(constants, "buttons_interrupt", qint_from_int(BUTTONS_INTERRUPT));
+#endif
+#ifdef GPIO_IN_INTERRUPT
+    qdict_put(constants, "gpio_in_interrupt", qint_from_int(GPIO_IN_INTERRUPT));
+#endif
+#ifdef FLASH_BOOT_ADDRESS
+    qdict_put(constants, "flash_boot_address",
+              qint_from_int(FLASH_BOOT_ADDRESS));
+#endif
+#ifdef SYSTEM_CLOCK_FREQUENCY
+    qdict_put(constants, "system_clock_frequency",
+              qint_from_int(SYSTEM_CLOCK_FREQUENCY));
+#endif
+
+#ifdef ROM_BASE
+    builtin_add_memory(memories, "rom", ROM_BASE, ROM_SIZE);
+#endif
+#ifdef SRAM_BASE
+    builtin_add_memory(memories, "sram", SRAM_BASE, SRAM_SIZE);
+#endif
+#ifdef MAIN_RAM_BASE
+    builtin_add_memory(memories, "main_ram", MAIN_RAM_BASE, MAIN_RAM_SIZE);
+#endif
+#ifdef ETHMAC_BASE
+    builtin_add_memory(memories, "ethmac", ETHMAC_BASE, ETHMAC_SIZE);
+#endif
+#ifdef SPIFLASH_BASE
+    builtin_add_memory(memories, "spiflash", SPIFLASH_BASE, SPIFLASH_SIZE);
+#endif
+
+    csr->root = qdict_new();
+    qdict_put(csr->root, "csr_bases", bases);
+    qdict_put(csr->root, "constants", constants);
+    qdict_put(csr->root, "memories", memories);
+    return csr;
+}
+
+void litex_csr_free(LitexCsr *csr)
+{
+    if (csr) {
+        QDECREF(csr->root);
+        g_free(csr);
+    }
+}
+
+static bool lookup_int(QDict *dict, const char *name, int64_t *value)
+{
+    QInt *qint;
+
+    if (!dict) {
+        return false;
+    }
+    qint = qobject_to_qint(qdict_get(dict, name));
+    if (!qint) {
+        return false;
+    }
+    *value = qint_get_int(qint);
+    return true;
+}
+
+bool litex_csr_base(LitexCsr *csr, const char *name, hwaddr *base)
+{
+    int64_t v;
+
+    if (!lookup_int(qobject_to_qdict(qdict_get(csr->root, "csr_bases")),
+                    name, &v)) {
+        return false;
+    }
+    *base = v;
+    return true;
+}
+
+bool litex_csr_constant(LitexCsr *csr, const char *name, int64_t *value)
+{
+    return lookup_int(qobject_to_qdict(qdict_get(csr->root, "constants")),
+                      name, value);
+}
+
+bool litex_csr_memory(LitexCsr *csr, const char *name,
+                      hwaddr *base, uint64_t *size)
+{
+    QDict *memories = qobject_to_qdict(qdict_get(csr->root, "memories"));
+    QDict *mem;
+    int64_t b, s;
+
+    if (!memories) {
+        return false;
+    }
+    mem = qobject_to_qdict(qdict_get(memories, name));
+    if (!lookup_int(mem, "base", &b) || !lookup_int(mem, "size", &s)) {
+        return false;
+    }
+    *base = b;
+    *size = s;
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef QEMU_HW_LITEX_CSR_H
+#define QEMU_HW_LITEX_CSR_H
+
+#include "qapi/qmp/qdict.h"
+
+/*
+ * Description of a LiteX SoC, laid out like the csr.json file emitted by
+ * the LiteX build system:
+ *
+ *   { "csr_bases": { "uart": 3758100480, ... },
+ *     "constants": { "uart_interrupt": 0, ... },
+ *     "memories":  { "rom": { "base": 0, "size": 32768 }, ... } }
+ */
+typedef struct LitexCsr {
+    QDict *root;
+} LitexCsr;
+
+LitexCsr *litex_csr_load(const char *filename, Error **errp);
+LitexCsr *litex_csr_builtin(void);
+void litex_csr_free(LitexCsr *csr);
+
+bool litex_csr_base(LitexCsr *csr, const char *name, hwaddr *base);
+bool litex_csr_constant(LitexCsr *csr, const char *name, int64_t *value);
+bool litex_csr_memory(LitexCsr *csr, const char *name,
+                      hwaddr *base, uint64_t *size);
+
+#endif /* QEMU_HW_LITEX_CSR_H */
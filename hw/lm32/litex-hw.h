@@ -3,6 +3,8 @@
 
 #include "hw/qdev.h"
 #include "net/net.h"
+#include "qapi/error.h"
+#include "sysemu/block-backend.h"
 
 static inline DeviceState *litex_uart_create(hwaddr base,
                                              qemu_irq irq,
@@ -21,6 +23,133 @@ static inline DeviceState *litex_uart_create(hwaddr base,
 
 
 
+static inline DeviceState *litex_ethmac_create(hwaddr base,
+                                               hwaddr buffers_base,
+                                               qemu_irq irq,
+                                               uint32_t rx_slots,
+                                               uint32_t tx_slots)
+{
+    DeviceState *dev;
+
+    qemu_check_nic_model(&nd_table[0], "liteeth");
+    dev = qdev_create(NULL, "litex-ethmac");
+    qdev_set_nic_properties(dev, &nd_table[0]);
+    qdev_prop_set_uint32(dev, "rx-slots", rx_slots);
+    qdev_prop_set_uint32(dev, "tx-slots", tx_slots);
+    qdev_init_nofail(dev);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, base);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 1, buffers_base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0, irq);
+
+    return dev;
+}
+
+static inline DeviceState *litex_spiflash_create(hwaddr base,
+                                                 hwaddr xip_base,
+                                                 uint32_t size,
+                                                 const char *file,
+                                                 BlockBackend *blk)
+{
+    DeviceState *dev;
+
+    dev = qdev_create(NULL, "litex-spiflash");
+    qdev_prop_set_uint32(dev, "size", size);
+    if (file) {
+        qdev_prop_set_string(dev, "file", file);
+    }
+    if (blk) {
+        qdev_prop_set_drive(dev, "drive", blk, &error_fatal);
+    }
+    qdev_init_nofail(dev);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, base);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 1, xip_base);
+
+    return dev;
+}
+
+static inline DeviceState *litex_mailbox_create(hwaddr base,
+                                                qemu_irq *cpu_irqs,
+                                                int num_cpus)
+{
+    DeviceState *dev;
+    int i;
+
+    dev = qdev_create(NULL, "litex-mailbox");
+    qdev_prop_set_uint32(dev, "num-cpus", num_cpus);
+    qdev_init_nofail(dev);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, base);
+    for (i = 0; i < num_cpus; i++) {
+        sysbus_connect_irq(SYS_BUS_DEVICE(dev), i, cpu_irqs[i]);
+    }
+
+    return dev;
+}
+
+static inline DeviceState *litex_dma_create(hwaddr base, qemu_irq irq)
+{
+    DeviceState *dev;
+
+    dev = qdev_create(NULL, "litex-dma");
+    qdev_init_nofail(dev);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0, irq);
+
+    return dev;
+}
+
+static inline DeviceState *litex_sdcard_create(hwaddr phy_base,
+                                               hwaddr core_base,
+                                               hwaddr block2mem_base,
+                                               hwaddr mem2block_base,
+                                               hwaddr irq_base,
+                                               qemu_irq irq)
+{
+    DeviceState *dev;
+
+    dev = qdev_create(NULL, "litex-sdcard");
+    qdev_init_nofail(dev);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, phy_base);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 1, core_base);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 2, block2mem_base);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 3, mem2block_base);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 4, irq_base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0, irq);
+
+    return dev;
+}
+
+static inline DeviceState *litex_framebuffer_create(hwaddr dma_base,
+                                                    hwaddr vtg_base,
+                                                    uint32_t depth)
+{
+    DeviceState *dev;
+
+    dev = qdev_create(NULL, "litex-framebuffer");
+    qdev_prop_set_uint32(dev, "depth", depth);
+    qdev_init_nofail(dev);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, dma_base);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 1, vtg_base);
+
+    return dev;
+}
+
+static inline DeviceState *litex_gpio_create(hwaddr base, uint32_t ngpio,
+                                             bool input, qemu_irq irq)
+{
+    DeviceState *dev;
+
+    dev = qdev_create(NULL, "litex-gpio");
+    qdev_prop_set_uint32(dev, "ngpio", ngpio);
+    qdev_prop_set_bit(dev, "input", input);
+    qdev_init_nofail(dev);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, base);
+    if (irq) {
+        sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0, irq);
+    }
+
+    return dev;
+}
+
 static inline DeviceState *litex_timer_create(hwaddr base, qemu_irq timer0_irq, uint32_t freq_hz)
 {
     DeviceState *dev;
@@ -24,28 +24,85 @@
 #include "hw/hw.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/qtest.h"
+#include "sysemu/memsnap.h"
 #include "hw/devices.h"
 #include "hw/boards.h"
 #include "hw/loader.h"
 #include "elf.h"
 #include "sysemu/block-backend.h"
+#include "sysemu/blockdev.h"
 #include "litex-hw.h"
 #include "litex.h"
+#include "litex-csr.h"
 #include "exec/address-spaces.h"
 #include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qapi/error.h"
 #include "hw/char/serial.h"
-#include "generated/csr.h"
-#include "generated/mem.h"
+#include "hw/lm32/lm32_pic.h"
 
 
 #define BIOS_FILENAME    "bios.bin"
 
+/* The CPU ignores the address MSB, CSRs are decoded in the shadow area */
+#define LITEX_CSR_ADDR(addr) ((addr) & 0x7FFFFFFF)
+
+#define LITEX_MAX_CPUS          8
+/* IPI block for -smp > 1 if the SoC description has none: last CSR slot */
+#define LITEX_MAILBOX_BASE      0xe000f800
+
+#define TYPE_LITEX_MACHINE MACHINE_TYPE_NAME("litex")
+#define LITEX_MACHINE(obj) \
+    OBJECT_CHECK(LitexMachineState, (obj), TYPE_LITEX_MACHINE)
+
+/*
+ * Fast-forward boot image, all fields little endian:
+ *
+ *   "LXFFBOOT", u32 version, u32 pc, u32 ie, u32 im, u32 eba, u32 deba,
+ *   u32 regs[32], u32 nr_chunks,
+ *   nr_chunks * { u32 addr, u32 len, u8 data[len] }
+ *
+ * Memory not covered by a chunk is left zeroed, so an image of a booted
+ * system only needs to carry the pages that were actually touched.
+ * Devices other than the interrupt controller start from their reset
+ * state.  Version 1 images have no im field; they are only accepted if
+ * they were taken with interrupts disabled.
+ * scripts/litex-ffboot.py builds one from pmemsave dumps.
+ */
+#define FFBOOT_MAGIC        "LXFFBOOT"
+#define FFBOOT_VERSION      2
+#define FFBOOT_HEADER_SIZE(version) \
+    (8 + 4 * (((version) >= 2 ? 6 : 5) + 32))
+
 typedef struct {
-    LM32CPU *cpu;
+    uint32_t pc;
+    uint32_t ie;
+    uint32_t im;
+    uint32_t eba;
+    uint32_t deba;
+    uint32_t regs[32];
+} LitexBootState;
+
+typedef struct {
+    LM32CPU *cpu[LITEX_MAX_CPUS];
+    int num_cpus;
     hwaddr bootstrap_pc;
     hwaddr flash_base;
+    hwaddr rom_base;
+    LitexBootState *boot_state;
 } ResetInfo;
 
+typedef struct {
+    MachineState parent_obj;
+
+    char *csr_json;
+    char *spiflash;
+    char *boot_state;
+    bool memsnap;
+
+    ResetInfo *reset_info;
+} LitexMachineState;
+
 static void cpu_irq_handler(void *opaque, int irq, int level)
 {
     LM32CPU *cpu = opaque;
@@ -58,84 +115,280 @@ static void cpu_irq_handler(void *opaque, int irq, int level)
     }
 }
 
+/*
+ * All CPUs start at the same entry point and tell themselves apart with
+ * the mailbox CPU_ID register, like the harts of a LiteX SMP SoC.
+ */
 static void main_cpu_reset(void *opaque)
 {
     ResetInfo *reset_info = opaque;
-    CPULM32State *env = &reset_info->cpu->env;
+    CPULM32State *env;
+    int i;
+
+    for (i = 0; i < reset_info->num_cpus; i++) {
+        env = &reset_info->cpu[i]->env;
 
-    cpu_reset(CPU(reset_info->cpu));
+        cpu_reset(CPU(reset_info->cpu[i]));
 
-    /* init defaults */
-    env->pc = reset_info->bootstrap_pc;
-    env->eba = ROM_BASE;
-    env->deba = ROM_BASE;
+        /* init defaults */
+        env->pc = reset_info->bootstrap_pc;
+        env->eba = reset_info->rom_base;
+        env->deba = reset_info->rom_base;
+    }
+}
+
+/*
+ * A fast-forward boot state only describes the boot CPU and its interrupt
+ * controller.  It is restored once every device has been reset, otherwise
+ * the PIC reset would clear IM again.
+ */
+static void litex_machine_reset(void)
+{
+    LitexMachineState *lms = LITEX_MACHINE(qdev_get_machine());
+    ResetInfo *reset_info = lms->reset_info;
+    LitexBootState *bs;
+    CPULM32State *env;
+
+    qemu_devices_reset();
+
+    if (!reset_info || !reset_info->boot_state) {
+        return;
+    }
+
+    bs = reset_info->boot_state;
+    env = &reset_info->cpu[0]->env;
+    memcpy(env->regs, bs->regs, sizeof(env->regs));
+    env->pc = bs->pc;
+    env->ie = bs->ie;
+    env->eba = bs->eba;
+    env->deba = bs->deba;
+    lm32_pic_set_im(env->pic_state, bs->im);
+}
+
+/*
+ * Register the memory chunks of a fast-forward image with the rom loader,
+ * so they are restored on every reset, and return the CPU state.
+ */
+static LitexBootState *litex_load_boot_state(const char *filename)
+{
+    LitexBootState *bs;
+    gchar *contents;
+    gsize length;
+    gsize pos;
+    uint32_t version;
+    uint32_t nr_chunks;
+    uint32_t i;
+
+    if (!g_file_get_contents(filename, &contents, &length, NULL)) {
+        error_report("qemu: could not read boot state '%s'", filename);
+        exit(1);
+    }
+    version = length >= 12 ? ldl_le_p(contents + 8) : 0;
+    if (version < 1 || version > FFBOOT_VERSION ||
+        length < FFBOOT_HEADER_SIZE(version) + 4 ||
+        memcmp(contents, FFBOOT_MAGIC, 8)) {
+        error_report("qemu: '%s' is not a LiteX boot state image", filename);
+        exit(1);
+    }
+
+    bs = g_new0(LitexBootState, 1);
+    pos = 12;
+    bs->pc = ldl_le_p(contents + pos);
+    bs->ie = ldl_le_p(contents + pos + 4);
+    pos += 8;
+    if (version >= 2) {
+        bs->im = ldl_le_p(contents + pos);
+        pos += 4;
+    } else if (bs->ie & IE_IE) {
+        error_report("qemu: boot state '%s' was taken with interrupts "
+                     "enabled but has no interrupt mask, rebuild it with "
+                     "--im", filename);
+        exit(1);
+    }
+    bs->eba = ldl_le_p(contents + pos);
+    bs->deba = ldl_le_p(contents + pos + 4);
+    pos += 8;
+    for (i = 0; i < 32; i++) {
+        bs->regs[i] = ldl_le_p(contents + pos + 4 * i);
+    }
+
+    pos = FFBOOT_HEADER_SIZE(version);
+    nr_chunks = ldl_le_p(contents + pos);
+    pos += 4;
+    for (i = 0; i < nr_chunks; i++) {
+        uint32_t addr, len;
+
+        if (length - pos < 8) {
+            break;
+        }
+        addr = ldl_le_p(contents + pos);
+        len = ldl_le_p(contents + pos + 4);
+        pos += 8;
+        if (length - pos < len) {
+            break;
+        }
+        rom_add_blob_fixed("litex.boot-state", contents + pos, len, addr);
+        pos += len;
+    }
+    g_free(contents);
+
+    if (i != nr_chunks) {
+        error_report("qemu: boot state '%s' is truncated", filename);
+        exit(1);
+    }
+    return bs;
+}
+
+static void litex_add_ram(LitexCsr *csr, const char *region,
+                          const char *name, bool required, bool memsnap)
+{
+    MemoryRegion *mr;
+    hwaddr base;
+    uint64_t size;
+
+    if (!litex_csr_memory(csr, region, &base, &size)) {
+        if (required) {
+            error_report("qemu: LiteX SoC description has no '%s' region",
+                         region);
+            exit(1);
+        }
+        return;
+    }
+
+    mr = g_new(MemoryRegion, 1);
+    if (memsnap) {
+        memsnap_allocate_system_memory(mr, NULL, name, size);
+    } else {
+        memory_region_allocate_system_memory(mr, NULL, name, size);
+    }
+    memory_region_add_subregion(get_system_memory(), base, mr);
+}
+
+/* GPIO blocks, the width is given by the "<name>_ngpio" constant */
+static const struct {
+    const char *name;
+    bool input;
+    uint32_t ngpio;
+} litex_gpio_blocks[] = {
+    { "leds",       false, 8 },
+    { "switches",   true,  8 },
+    { "buttons",    true,  8 },
+    { "gpio_out",   false, 32 },
+    { "gpio_in",    true,  32 },
+};
+
+static int litex_irq_number(LitexCsr *csr, const char *name, int def)
+{
+    int64_t v;
+
+    if (!litex_csr_constant(csr, name, &v)) {
+        return def;
+    }
+    if (v < 0 || v >= 32) {
+        error_report("qemu: LiteX constant '%s' is not a valid irq (%" PRId64
+                     ")", name, v);
+        exit(1);
+    }
+    return v;
 }
 
 static void
 litex_init(MachineState *machine)
 {
+    LitexMachineState *lms = LITEX_MACHINE(machine);
     const char *cpu_model = machine->cpu_model;
     const char *kernel_filename = machine->kernel_filename;
-    
+
     LM32CPU *cpu;
     CPULM32State *env;
+    LitexCsr *csr;
+    Error *err = NULL;
 
     int kernel_size;
-    MemoryRegion *address_space_mem = get_system_memory();
-
-    MemoryRegion *phys_rom = g_new(MemoryRegion, 1);
-    MemoryRegion *phys_sram = g_new(MemoryRegion, 1);
-    MemoryRegion *phys_main_ram = g_new(MemoryRegion, 1);
-
 
+    hwaddr rom_base;
+    hwaddr flash_base = 0;
+    hwaddr main_ram_base = 0;
+    hwaddr csr_base;
+    uint64_t rom_size;
+    uint64_t flash_size = 0;
+    uint64_t main_ram_size = 0;
+    int64_t clk_freq;
 
-    hwaddr rom_base   = ROM_BASE;
-    hwaddr sram_base   = SRAM_BASE;
-    hwaddr main_ram_base   = MAIN_RAM_BASE;
-    
-    size_t rom_size   = ROM_SIZE;
-    size_t sram_size   = SRAM_SIZE;
-    size_t main_ram_size   = MAIN_RAM_SIZE;
-
-    
     qemu_irq irq[32];
-    int i;
+    qemu_irq ipi_irq[LITEX_MAX_CPUS];
+    int i, n;
     char *bios_filename;
     ResetInfo *reset_info;
 
+    if (lms->csr_json) {
+        csr = litex_csr_load(lms->csr_json, &err);
+        if (!csr) {
+            error_report_err(err);
+            exit(1);
+        }
+    } else {
+        csr = litex_csr_builtin();
+    }
+
+    if (!litex_csr_constant(csr, "system_clock_frequency", &clk_freq) &&
+        !litex_csr_constant(csr, "config_clock_frequency", &clk_freq)) {
+        clk_freq = 80000000;
+    }
+
     reset_info = g_malloc0(sizeof(ResetInfo));
 
     if (cpu_model == NULL) {
         cpu_model = "lm32-full";
     }
-    cpu = cpu_lm32_init(cpu_model);
-    if (cpu == NULL) {
-        fprintf(stderr, "qemu: unable to find CPU '%s'\n", cpu_model);
-        exit(1);
-    }
-
-    env = &cpu->env;
-    reset_info->cpu = cpu;
+    reset_info->num_cpus = smp_cpus;
+    for (n = 0; n < smp_cpus; n++) {
+        cpu = cpu_lm32_init(cpu_model);
+        if (cpu == NULL) {
+            fprintf(stderr, "qemu: unable to find CPU '%s'\n", cpu_model);
+            exit(1);
+        }
+        reset_info->cpu[n] = cpu;
 
-    /** addresses from 0x80000000 to 0xFFFFFFFF are not shadowed */
-    cpu_lm32_set_phys_msb_ignore(env, 1);
+        /** addresses from 0x80000000 to 0xFFFFFFFF are not shadowed */
+        cpu_lm32_set_phys_msb_ignore(&cpu->env, 1);
 
-    memory_region_allocate_system_memory(phys_rom, NULL, "litex.rom", rom_size);
-    memory_region_add_subregion(address_space_mem, rom_base, phys_rom);
+        /* every CPU has its own interrupt controller */
+        cpu->env.pic_state = litex_pic_init(qemu_allocate_irq(cpu_irq_handler,
+                                                              cpu, 0));
+    }
+    cpu = reset_info->cpu[0];
+    env = &cpu->env;
 
-    memory_region_allocate_system_memory(phys_sram, NULL, "litex.sram",    sram_size);
-    memory_region_add_subregion(address_space_mem, sram_base, phys_sram);
+    litex_add_ram(csr, "rom", "litex.rom", true, lms->memsnap);
+    litex_add_ram(csr, "sram", "litex.sram", false, lms->memsnap);
+    litex_add_ram(csr, "main_ram", "litex.main_ram", false, lms->memsnap);
 
-    memory_region_allocate_system_memory(phys_main_ram, NULL, "litex.main_ram", main_ram_size);
-    memory_region_add_subregion(address_space_mem, main_ram_base, phys_main_ram);
+    litex_csr_memory(csr, "rom", &rom_base, &rom_size);
+    litex_csr_memory(csr, "main_ram", &main_ram_base, &main_ram_size);
+    reset_info->rom_base = rom_base;
 
-    
-    /* create irq lines */
-    env->pic_state = litex_pic_init(qemu_allocate_irq(cpu_irq_handler, cpu, 0));
+    /* peripherals interrupt the boot CPU */
     for (i = 0; i < 32; i++) {
         irq[i] = qdev_get_gpio_in(env->pic_state, i);
     }
 
+    /* spi flash, the xip window is mapped like the other memories */
+    if (litex_csr_base(csr, "spiflash", &csr_base) &&
+        litex_csr_memory(csr, "spiflash", &flash_base, &flash_size)) {
+        DriveInfo *dinfo = drive_get_next(IF_MTD);
+        int64_t boot_address;
+
+        litex_spiflash_create(LITEX_CSR_ADDR(csr_base), flash_base, flash_size,
+                              lms->spiflash,
+                              dinfo ? blk_by_legacy_dinfo(dinfo) : NULL);
+        if (litex_csr_constant(csr, "flash_boot_address", &boot_address)) {
+            reset_info->flash_base = boot_address;
+        } else {
+            reset_info->flash_base = flash_base;
+        }
+    }
+
     /* load bios rom */
     if (bios_name == NULL) {
         bios_name = BIOS_FILENAME;
@@ -143,40 +396,153 @@ litex_init(MachineState *machine)
     bios_filename = qemu_find_file(QEMU_FILE_TYPE_BIOS, bios_name);
 
     if (bios_filename) {
-        load_image_targphys(bios_filename, ROM_BASE, ROM_SIZE);
+        load_image_targphys(bios_filename, rom_base, rom_size);
     }
-    reset_info->bootstrap_pc = ROM_BASE;
+    reset_info->bootstrap_pc = rom_base;
 
+    /* without a bios, jump straight to the firmware in flash */
+    if (!bios_filename && flash_size &&
+        (lms->spiflash || drive_get(IF_MTD, 0, 0))) {
+        reset_info->bootstrap_pc = reset_info->flash_base;
+    }
 
     /* if no kernel is given no valid bios rom is a fatal error */
-    if (!kernel_filename  && !bios_filename && !qtest_enabled()) {
+    if (!kernel_filename  && !bios_filename && !lms->boot_state &&
+        reset_info->bootstrap_pc == rom_base && !qtest_enabled()) {
         fprintf(stderr, "qemu: could not load Milkymist One bios '%s'\n",
                 bios_name);
         exit(1);
     }
     g_free(bios_filename);
 
-   
-
     /* litex uart */
-#ifdef CSR_UART_BASE
-    litex_uart_create(CSR_UART_BASE & 0x7FFFFFFF, irq[0], serial_hds[0]);
-#endif
+    if (litex_csr_base(csr, "uart", &csr_base)) {
+        litex_uart_create(LITEX_CSR_ADDR(csr_base),
+                          irq[litex_irq_number(csr, "uart_interrupt", 0)],
+                          serial_hds[0]);
+    } else if (litex_csr_base(csr, "uart16550", &csr_base)) {
+        /* INIT UART 16550 */
+        serial_mm_init(get_system_memory(), LITEX_CSR_ADDR(csr_base), 2,
+                       irq[litex_irq_number(csr, "uart_interrupt", 0)],
+                       115200, serial_hds[0], DEVICE_NATIVE_ENDIAN);
+    }
 
     /* litex timer*/
-#ifdef CSR_TIMER0_BASE
-    litex_timer_create(CSR_TIMER0_BASE & 0x7FFFFFFF, irq[1], 80000000);
-#endif
-    
-    /* INIT UART 16550 */
-#ifndef CSR_UART_BASE
- #ifdef CSR_UART16550_BASE
-    serial_mm_init(address_space_mem, CSR_UART16550_BASE & 0x7FFFFFFF, 2, irq[0],   115200, serial_hds[0], DEVICE_NATIVE_ENDIAN); */
- #endif
-#endif
-        
+    if (litex_csr_base(csr, "timer0", &csr_base)) {
+        litex_timer_create(LITEX_CSR_ADDR(csr_base),
+                           irq[litex_irq_number(csr, "timer0_interrupt", 1)],
+                           clk_freq);
+    }
+
+    /* liteeth */
+    if (litex_csr_base(csr, "ethmac", &csr_base)) {
+        hwaddr buffers_base;
+        uint64_t buffers_size;
+        int64_t rx_slots, tx_slots;
+
+        if (!litex_csr_memory(csr, "ethmac", &buffers_base, &buffers_size)) {
+            error_report("qemu: LiteX SoC description has no 'ethmac' region");
+            exit(1);
+        }
+        if (!litex_csr_constant(csr, "ethmac_rx_slots", &rx_slots)) {
+            rx_slots = 2;
+        }
+        if (!litex_csr_constant(csr, "ethmac_tx_slots", &tx_slots)) {
+            tx_slots = 2;
+        }
+        litex_ethmac_create(LITEX_CSR_ADDR(csr_base),
+                            LITEX_CSR_ADDR(buffers_base),
+                            irq[litex_irq_number(csr, "ethmac_interrupt", 2)],
+                            rx_slots, tx_slots);
+    }
+
+    /* memory to memory DMA */
+    if (litex_csr_base(csr, "dma", &csr_base)) {
+        litex_dma_create(LITEX_CSR_ADDR(csr_base),
+                         irq[litex_irq_number(csr, "dma_interrupt", 4)]);
+    }
+
+    /* litesdcard */
+    if (litex_csr_base(csr, "sdcore", &csr_base)) {
+        hwaddr phy_base, block2mem_base, mem2block_base, irq_base;
+
+        if (!litex_csr_base(csr, "sdphy", &phy_base) ||
+            !litex_csr_base(csr, "sdblock2mem", &block2mem_base) ||
+            !litex_csr_base(csr, "sdmem2block", &mem2block_base) ||
+            !litex_csr_base(csr, "sdirq", &irq_base)) {
+            error_report("qemu: LiteX SoC description has an incomplete "
+                         "sdcard");
+            exit(1);
+        }
+        litex_sdcard_create(LITEX_CSR_ADDR(phy_base),
+                            LITEX_CSR_ADDR(csr_base),
+                            LITEX_CSR_ADDR(block2mem_base),
+                            LITEX_CSR_ADDR(mem2block_base),
+                            LITEX_CSR_ADDR(irq_base),
+                            irq[litex_irq_number(csr, "sdcard_interrupt", 5)]);
+    }
+
+    /* video framebuffer */
+    if (litex_csr_base(csr, "video_framebuffer", &csr_base)) {
+        hwaddr vtg_base;
+        int64_t depth;
+
+        if (!litex_csr_base(csr, "video_framebuffer_vtg", &vtg_base)) {
+            error_report("qemu: LiteX SoC description has no "
+                         "'video_framebuffer_vtg' block");
+            exit(1);
+        }
+        if (!litex_csr_constant(csr, "video_framebuffer_depth", &depth)) {
+            depth = 32;
+        }
+        litex_framebuffer_create(LITEX_CSR_ADDR(csr_base),
+                                 LITEX_CSR_ADDR(vtg_base), depth);
+    }
+
+    /* leds, switches and gpios */
+    for (i = 0; i < ARRAY_SIZE(litex_gpio_blocks); i++) {
+        const char *name = litex_gpio_blocks[i].name;
+        gchar *constant;
+        int64_t ngpio;
+        int gpio_irq = -1;
+
+        if (!litex_csr_base(csr, name, &csr_base)) {
+            continue;
+        }
+        constant = g_strdup_printf("%s_ngpio", name);
+        if (!litex_csr_constant(csr, constant, &ngpio)) {
+            ngpio = litex_gpio_blocks[i].ngpio;
+        }
+        g_free(constant);
+        if (litex_gpio_blocks[i].input) {
+            constant = g_strdup_printf("%s_interrupt", name);
+            gpio_irq = litex_irq_number(csr, constant, -1);
+            g_free(constant);
+        }
+        litex_gpio_create(LITEX_CSR_ADDR(csr_base), ngpio,
+                          litex_gpio_blocks[i].input,
+                          gpio_irq < 0 ? NULL : irq[gpio_irq]);
+    }
+
+    /* inter-processor interrupts and mailboxes */
+    if (smp_cpus > 1) {
+        int ipi = litex_irq_number(csr, "mailbox_interrupt", 3);
+
+        if (!litex_csr_base(csr, "mailbox", &csr_base)) {
+            csr_base = LITEX_MAILBOX_BASE;
+        }
+        for (n = 0; n < smp_cpus; n++) {
+            ipi_irq[n] = qdev_get_gpio_in(reset_info->cpu[n]->env.pic_state,
+                                          ipi);
+        }
+        litex_mailbox_create(LITEX_CSR_ADDR(csr_base), ipi_irq, smp_cpus);
+    }
+
     /* make sure juart isn't the first chardev */
     env->juart_state = lm32_juart_init(serial_hds[1]);
+    for (n = 1; n < smp_cpus; n++) {
+        reset_info->cpu[n]->env.juart_state = env->juart_state;
+    }
 
     if (kernel_filename) {
         uint64_t entry;
@@ -185,7 +551,7 @@ litex_init(MachineState *machine)
         kernel_size = load_elf(kernel_filename, NULL, NULL, &entry, NULL, NULL, 1, EM_LATTICEMICO32, 0, 0);
         reset_info->bootstrap_pc = entry;
 
-        if (kernel_size < 0) {
+        if (kernel_size < 0 && main_ram_size) {
             kernel_size = load_image_targphys(kernel_filename, main_ram_base,   main_ram_size);
             reset_info->bootstrap_pc = main_ram_base;
         }
@@ -196,14 +562,138 @@ litex_init(MachineState *machine)
         }
     }
 
+    /* skip the bios and restore a previously booted system */
+    if (lms->boot_state) {
+        reset_info->boot_state = litex_load_boot_state(lms->boot_state);
+    }
+
+    litex_csr_free(csr);
+
+    lms->reset_info = reset_info;
     qemu_register_reset(main_cpu_reset, reset_info);
 }
 
-static void litex_machine_init(MachineClass *mc)
+static char *litex_get_csr_json(Object *obj, Error **errp)
 {
+    LitexMachineState *lms = LITEX_MACHINE(obj);
+
+    return g_strdup(lms->csr_json);
+}
+
+static void litex_set_csr_json(Object *obj, const char *value, Error **errp)
+{
+    LitexMachineState *lms = LITEX_MACHINE(obj);
+
+    g_free(lms->csr_json);
+    lms->csr_json = g_strdup(value);
+}
+
+static char *litex_get_spiflash(Object *obj, Error **errp)
+{
+    LitexMachineState *lms = LITEX_MACHINE(obj);
+
+    return g_strdup(lms->spiflash);
+}
+
+static void litex_set_spiflash(Object *obj, const char *value, Error **errp)
+{
+    LitexMachineState *lms = LITEX_MACHINE(obj);
+
+    g_free(lms->spiflash);
+    lms->spiflash = g_strdup(value);
+}
+
+static char *litex_get_boot_state(Object *obj, Error **errp)
+{
+    LitexMachineState *lms = LITEX_MACHINE(obj);
+
+    return g_strdup(lms->boot_state);
+}
+
+static void litex_set_boot_state(Object *obj, const char *value, Error **errp)
+{
+    LitexMachineState *lms = LITEX_MACHINE(obj);
+
+    g_free(lms->boot_state);
+    lms->boot_state = g_strdup(value);
+}
+
+static bool litex_get_memsnap(Object *obj, Error **errp)
+{
+    LitexMachineState *lms = LITEX_MACHINE(obj);
+
+    return lms->memsnap;
+}
+
+static void litex_set_memsnap(Object *obj, bool value, Error **errp)
+{
+    LitexMachineState *lms = LITEX_MACHINE(obj);
+
+    lms->memsnap = value;
+}
+
+static void litex_machine_instance_init(Object *obj)
+{
+    object_property_add_str(obj, "csr-json", litex_get_csr_json,
+                            litex_set_csr_json, NULL);
+    object_property_set_description(obj, "csr-json",
+                                    "LiteX csr.json describing the SoC "
+                                    "memory map, overrides the built-in "
+                                    "layout", NULL);
+
+    object_property_add_str(obj, "spiflash", litex_get_spiflash,
+                            litex_set_spiflash, NULL);
+    object_property_set_description(obj, "spiflash",
+                                    "SPI flash image, mmap()ed as the XIP "
+                                    "window instead of being copied", NULL);
+
+    object_property_add_str(obj, "boot-state", litex_get_boot_state,
+                            litex_set_boot_state, NULL);
+    object_property_set_description(obj, "boot-state",
+                                    "Fast-forward image preloading memory "
+                                    "and CPU registers, skips the bios",
+                                    NULL);
+
+    object_property_add_bool(obj, "memsnap", litex_get_memsnap,
+                             litex_set_memsnap, NULL);
+    object_property_set_description(obj, "memsnap",
+                                    "Back the RAM for fast in-memory "
+                                    "snapshots (memsnap-save/memsnap-load)",
+                                    NULL);
+}
+
+static void litex_machine_instance_finalize(Object *obj)
+{
+    LitexMachineState *lms = LITEX_MACHINE(obj);
+
+    g_free(lms->csr_json);
+    g_free(lms->spiflash);
+    g_free(lms->boot_state);
+}
+
+static void litex_machine_class_init(ObjectClass *oc, void *data)
+{
+    MachineClass *mc = MACHINE_CLASS(oc);
+
     mc->desc = "Litex One";
     mc->init = litex_init;
+    mc->reset = litex_machine_reset;
+    mc->max_cpus = LITEX_MAX_CPUS;
     mc->is_default = 0;
 }
 
-DEFINE_MACHINE("litex", litex_machine_init)
+static const TypeInfo litex_machine_type = {
+    .name = TYPE_LITEX_MACHINE,
+    .parent = TYPE_MACHINE,
+    .instance_size = sizeof(LitexMachineState),
+    .instance_init = litex_machine_instance_init,
+    .instance_finalize = litex_machine_instance_finalize,
+    .class_init = litex_machine_class_init,
+};
+
+static void litex_machine_init(void)
+{
+    type_register_static(&litex_machine_type);
+}
+
+type_init(litex_machine_init)
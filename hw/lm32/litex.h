@@ -8,7 +8,7 @@ static inline DeviceState *litex_pic_init(qemu_irq cpu_irq)
     DeviceState *dev;
     SysBusDevice *d;
 
-    dev = qdev_create(NULL, "lm32-pic");
+    dev = qdev_create(NULL, "litex-pic");
     qdev_init_nofail(dev);
     d = SYS_BUS_DEVICE(dev);
     sysbus_connect_irq(d, 0, cpu_irq);
@@ -0,0 +1,278 @@
+/*
+ *  QEMU model of a LiteX inter-processor interrupt / mailbox block.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Like the other LiteX CSR blocks every register is 8 bits wide and
+ * occupies a 32-bit word; 32-bit values are split over four registers,
+ * most significant byte first.
+ *
+ *   CPU_ID          index of the CPU doing the access
+ *   NUM_CPUS        number of CPUs in the system
+ *
+ * followed by one bank per CPU:
+ *
+ *   IPI_SET         writing 1s sets the matching pending bits
+ *   IPI_CLEAR       writing 1s clears the matching pending bits
+ *   IPI_PENDING     pending IPIs, the CPU's interrupt is raised while
+ *                   this is non-zero
+ *   MSG0..MSG3      32-bit message word, free for software use
+ *
+ * With multi-threaded TCG the CPUs access the block concurrently; the
+ * region keeps global locking, so every access and the IPI it raises in
+ * another CPU's PIC happen under the BQL.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/hw.h"
+#include "hw/sysbus.h"
+#include "qom/cpu.h"
+#include "trace.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+
+#define LITEX_MAILBOX_MAX_CPUS 8
+
+enum {
+    R_CPU_ID = 0,
+    R_NUM_CPUS,
+    R_GLOBAL_MAX
+};
+
+enum {
+    R_IPI_SET = 0,
+    R_IPI_CLEAR,
+    R_IPI_PENDING,
+    R_MSG0,
+    R_MSG1,
+    R_MSG2,
+    R_MSG3,
+    R_BANK_MAX
+};
+
+#define R_BANK(cpu) (R_GLOBAL_MAX + (cpu) * R_BANK_MAX)
+
+#define TYPE_LITEX_MAILBOX "litex-mailbox"
+#define LITEX_MAILBOX(obj) \
+    OBJECT_CHECK(LitexMailboxState, (obj), TYPE_LITEX_MAILBOX)
+
+typedef struct LitexMailboxBank {
+    uint8_t pending;
+    uint32_t msg;
+} LitexMailboxBank;
+
+struct LitexMailboxState {
+    SysBusDevice parent_obj;
+
+    MemoryRegion regs_region;
+
+    uint32_t num_cpus;
+    LitexMailboxBank bank[LITEX_MAILBOX_MAX_CPUS];
+
+    qemu_irq irq[LITEX_MAILBOX_MAX_CPUS];
+};
+typedef struct LitexMailboxState LitexMailboxState;
+
+static void mailbox_update_irq(LitexMailboxState *s, int cpu)
+{
+    qemu_set_irq(s->irq[cpu], s->bank[cpu].pending != 0);
+}
+
+static uint64_t mailbox_read(void *opaque, hwaddr addr, unsigned size)
+{
+    LitexMailboxState *s = opaque;
+    uint32_t r = 0;
+    int cpu, reg;
+
+    addr >>= 2;
+    if (addr < R_GLOBAL_MAX) {
+        switch (addr) {
+        case R_CPU_ID:
+            r = current_cpu ? current_cpu->cpu_index : 0;
+            break;
+        case R_NUM_CPUS:
+            r = s->num_cpus;
+            break;
+        }
+        trace_litex_mailbox_read(addr << 2, r);
+        return r;
+    }
+
+    cpu = (addr - R_GLOBAL_MAX) / R_BANK_MAX;
+    reg = (addr - R_GLOBAL_MAX) % R_BANK_MAX;
+    if (cpu >= s->num_cpus) {
+        error_report("litex_mailbox: read access to unknown register 0x"
+                TARGET_FMT_plx, addr << 2);
+        return 0;
+    }
+
+    switch (reg) {
+    case R_IPI_PENDING:
+        r = s->bank[cpu].pending;
+        break;
+    case R_MSG0:
+    case R_MSG1:
+    case R_MSG2:
+    case R_MSG3:
+        r = (s->bank[cpu].msg >> (8 * (R_MSG3 - reg))) & 0xff;
+        break;
+    case R_IPI_SET:
+    case R_IPI_CLEAR:
+        break;
+    }
+
+    trace_litex_mailbox_read(addr << 2, r);
+    return r;
+}
+
+static void mailbox_write(void *opaque, hwaddr addr, uint64_t value,
+                          unsigned size)
+{
+    LitexMailboxState *s = opaque;
+    LitexMailboxBank *b;
+    int cpu, reg, shift;
+
+    trace_litex_mailbox_write(addr, value);
+
+    addr >>= 2;
+    if (addr < R_GLOBAL_MAX) {
+        /* CPU_ID and NUM_CPUS are read-only */
+        return;
+    }
+
+    cpu = (addr - R_GLOBAL_MAX) / R_BANK_MAX;
+    reg = (addr - R_GLOBAL_MAX) % R_BANK_MAX;
+    if (cpu >= s->num_cpus) {
+        error_report("litex_mailbox: write access to unknown register 0x"
+                TARGET_FMT_plx, addr << 2);
+        return;
+    }
+    b = &s->bank[cpu];
+
+    switch (reg) {
+    case R_IPI_SET:
+        b->pending |= value;
+        trace_litex_mailbox_ipi(cpu, b->pending);
+        mailbox_update_irq(s, cpu);
+        break;
+    case R_IPI_CLEAR:
+        b->pending &= ~value;
+        mailbox_update_irq(s, cpu);
+        break;
+    case R_MSG0:
+    case R_MSG1:
+    case R_MSG2:
+    case R_MSG3:
+        shift = 8 * (R_MSG3 - reg);
+        b->msg = (b->msg & ~(0xffu << shift)) | ((value & 0xff) << shift);
+        break;
+    case R_IPI_PENDING:
+        break;
+    }
+}
+
+static const MemoryRegionOps mailbox_mmio_ops = {
+    .read = mailbox_read,
+    .write = mailbox_write,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static void litex_mailbox_reset(DeviceState *d)
+{
+    LitexMailboxState *s = LITEX_MAILBOX(d);
+    int i;
+
+    for (i = 0; i < LITEX_MAILBOX_MAX_CPUS; i++) {
+        s->bank[i].pending = 0;
+        s->bank[i].msg = 0;
+    }
+}
+
+static void litex_mailbox_realize(DeviceState *dev, Error **errp)
+{
+    LitexMailboxState *s = LITEX_MAILBOX(dev);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
+    int i;
+
+    if (s->num_cpus < 1 || s->num_cpus > LITEX_MAILBOX_MAX_CPUS) {
+        error_setg(errp, "num-cpus must be between 1 and %d",
+                   LITEX_MAILBOX_MAX_CPUS);
+        return;
+    }
+
+    memory_region_init_io(&s->regs_region, OBJECT(dev), &mailbox_mmio_ops, s,
+                          "litex-mailbox",
+                          4 * R_BANK(LITEX_MAILBOX_MAX_CPUS));
+    sysbus_init_mmio(sbd, &s->regs_region);
+
+    for (i = 0; i < s->num_cpus; i++) {
+        sysbus_init_irq(sbd, &s->irq[i]);
+    }
+}
+
+static const VMStateDescription vmstate_litex_mailbox_bank = {
+    .name = "litex-mailbox-bank",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8(pending, LitexMailboxBank),
+        VMSTATE_UINT32(msg, LitexMailboxBank),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_litex_mailbox = {
+    .name = "litex-mailbox",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT_ARRAY(bank, LitexMailboxState, LITEX_MAILBOX_MAX_CPUS,
+                             1, vmstate_litex_mailbox_bank, LitexMailboxBank),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property litex_mailbox_properties[] = {
+    DEFINE_PROP_UINT32("num-cpus", LitexMailboxState, num_cpus, 1),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void litex_mailbox_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = litex_mailbox_realize;
+    dc->reset = litex_mailbox_reset;
+    dc->vmsd = &vmstate_litex_mailbox;
+    dc->props = litex_mailbox_properties;
+}
+
+static const TypeInfo litex_mailbox_info = {
+    .name          = TYPE_LITEX_MAILBOX,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(LitexMailboxState),
+    .class_init    = litex_mailbox_class_init,
+};
+
+static void litex_mailbox_register_types(void)
+{
+    type_register_static(&litex_mailbox_info);
+}
+
+type_init(litex_mailbox_register_types)
@@ -0,0 +1,412 @@
+/*
+ *  QEMU model of the LiteEth MAC (SRAM interface).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * The MAC moves frames through a small SRAM split into 2 KiB slots, the
+ * RX (writer) slots first, followed by the TX (reader) slots.  The SRAM
+ * is plain guest RAM here: received frames are copied once straight into
+ * the slot and transmitted frames are handed to the net layer in place.
+ * Preamble and CRC are handled by the "hardware", so slots only ever hold
+ * the bare ethernet frame.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu-common.h"
+#include "hw/hw.h"
+#include "hw/sysbus.h"
+#include "trace.h"
+#include "net/net.h"
+#include "qemu/error-report.h"
+#include "qemu/log.h"
+
+enum {
+    R_WRITER_SLOT = 0,
+    R_WRITER_LENGTH0,
+    R_WRITER_LENGTH1,
+    R_WRITER_LENGTH2,
+    R_WRITER_LENGTH3,
+    R_WRITER_ERRORS0,
+    R_WRITER_ERRORS1,
+    R_WRITER_ERRORS2,
+    R_WRITER_ERRORS3,
+    R_WRITER_EV_STATUS,
+    R_WRITER_EV_PENDING,
+    R_WRITER_EV_ENABLE,
+
+    R_READER_START,
+    R_READER_READY,
+    R_READER_SLOT,
+    R_READER_LENGTH0,
+    R_READER_LENGTH1,
+    R_READER_EV_STATUS,
+    R_READER_EV_PENDING,
+    R_READER_EV_ENABLE,
+
+    R_PREAMBLE_CRC,
+    R_MAX
+};
+
+#define EV_DONE         1
+#define SLOT_SIZE       2048
+#define MAX_SLOTS       16
+#define MIN_FRAME_SIZE  60
+
+#define TYPE_LITEX_ETHMAC "litex-ethmac"
+#define LITEX_ETHMAC(obj) \
+    OBJECT_CHECK(LitexEthmacState, (obj), TYPE_LITEX_ETHMAC)
+
+struct LitexEthmacState {
+    SysBusDevice parent_obj;
+
+    NICState *nic;
+    NICConf conf;
+    qemu_irq irq;
+
+    MemoryRegion regs_region;
+    MemoryRegion buffers;
+    uint8_t *buf;
+
+    uint32_t rx_slots;
+    uint32_t tx_slots;
+
+    /* filled RX slots form a ring starting at rx_head */
+    uint32_t rx_head;
+    uint32_t rx_count;
+    uint32_t rx_len[MAX_SLOTS];
+    uint32_t rx_errors;
+
+    uint32_t regs[R_MAX];
+};
+typedef struct LitexEthmacState LitexEthmacState;
+
+static void ethmac_set_reg(LitexEthmacState *s, int reg, int width,
+                           uint32_t val)
+{
+    int i;
+
+    for (i = width - 1; i >= 0; i--) {
+        s->regs[reg + i] = val & 0xff;
+        val >>= 8;
+    }
+}
+
+static uint32_t ethmac_get_reg(LitexEthmacState *s, int reg, int width)
+{
+    uint32_t val = 0;
+    int i;
+
+    for (i = 0; i < width; i++) {
+        val = (val << 8) | s->regs[reg + i];
+    }
+    return val;
+}
+
+static void ethmac_update_irq(LitexEthmacState *s)
+{
+    int level;
+
+    level = (s->regs[R_WRITER_EV_PENDING] & s->regs[R_WRITER_EV_ENABLE]) ||
+            (s->regs[R_READER_EV_PENDING] & s->regs[R_READER_EV_ENABLE]);
+    trace_litex_ethmac_irq(level);
+    qemu_set_irq(s->irq, level);
+}
+
+/* Expose the oldest filled RX slot to the guest. */
+static void ethmac_update_rx(LitexEthmacState *s)
+{
+    if (s->rx_count) {
+        s->regs[R_WRITER_SLOT] = s->rx_head;
+        ethmac_set_reg(s, R_WRITER_LENGTH0, 4, s->rx_len[s->rx_head]);
+        s->regs[R_WRITER_EV_STATUS] = EV_DONE;
+        s->regs[R_WRITER_EV_PENDING] = EV_DONE;
+    } else {
+        s->regs[R_WRITER_EV_STATUS] = 0;
+        s->regs[R_WRITER_EV_PENDING] = 0;
+    }
+    ethmac_update_irq(s);
+}
+
+static void ethmac_tx(LitexEthmacState *s)
+{
+    uint32_t slot = s->regs[R_READER_SLOT];
+    uint32_t len = ethmac_get_reg(s, R_READER_LENGTH0, 2);
+
+    if (slot >= s->tx_slots) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "litex_ethmac: tx from invalid slot %u\n", slot);
+    } else if (len > SLOT_SIZE) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "litex_ethmac: tx length %u exceeds slot size\n", len);
+    } else {
+        trace_litex_ethmac_tx_frame(slot, len);
+        qemu_send_packet(qemu_get_queue(s->nic),
+                         s->buf + (s->rx_slots + slot) * SLOT_SIZE, len);
+    }
+
+    s->regs[R_READER_EV_PENDING] |= EV_DONE;
+    ethmac_update_irq(s);
+}
+
+static int ethmac_can_rx(NetClientState *nc)
+{
+    LitexEthmacState *s = qemu_get_nic_opaque(nc);
+
+    return s->rx_count < s->rx_slots;
+}
+
+static ssize_t ethmac_rx(NetClientState *nc, const uint8_t *buf, size_t size)
+{
+    LitexEthmacState *s = qemu_get_nic_opaque(nc);
+    uint32_t slot;
+    uint8_t *dst;
+    size_t len;
+
+    if (s->rx_count == s->rx_slots) {
+        return 0;
+    }
+
+    if (size > SLOT_SIZE) {
+        s->rx_errors++;
+        ethmac_set_reg(s, R_WRITER_ERRORS0, 4, s->rx_errors);
+        return size;
+    }
+
+    slot = (s->rx_head + s->rx_count) % s->rx_slots;
+    dst = s->buf + slot * SLOT_SIZE;
+    len = MAX(size, MIN_FRAME_SIZE);
+
+    memcpy(dst, buf, size);
+    memset(dst + size, 0, len - size);
+    memory_region_set_dirty(&s->buffers, slot * SLOT_SIZE, len);
+
+    trace_litex_ethmac_rx_frame(slot, len);
+
+    s->rx_len[slot] = len;
+    s->rx_count++;
+    ethmac_update_rx(s);
+
+    return size;
+}
+
+static uint64_t ethmac_read(void *opaque, hwaddr addr, unsigned size)
+{
+    LitexEthmacState *s = opaque;
+    uint32_t r = 0;
+
+    addr >>= 2;
+    if (addr < R_MAX) {
+        r = s->regs[addr];
+    } else {
+        error_report("litex_ethmac: read access to unknown register 0x"
+                TARGET_FMT_plx, addr << 2);
+    }
+
+    trace_litex_ethmac_memory_read(addr << 2, r);
+    return r;
+}
+
+static void ethmac_write(void *opaque, hwaddr addr, uint64_t value,
+                         unsigned size)
+{
+    LitexEthmacState *s = opaque;
+
+    trace_litex_ethmac_memory_write(addr, value);
+
+    value &= 0xff;
+    addr >>= 2;
+    switch (addr) {
+    case R_WRITER_EV_PENDING:
+        /* acking the RX event releases the slot */
+        if ((value & EV_DONE) && s->rx_count) {
+            s->rx_head = (s->rx_head + 1) % s->rx_slots;
+            s->rx_count--;
+            ethmac_update_rx(s);
+            qemu_flush_queued_packets(qemu_get_queue(s->nic));
+        }
+        break;
+    case R_READER_EV_PENDING:
+        s->regs[addr] &= ~value;
+        ethmac_update_irq(s);
+        break;
+    case R_WRITER_EV_ENABLE:
+    case R_READER_EV_ENABLE:
+        s->regs[addr] = value & EV_DONE;
+        ethmac_update_irq(s);
+        break;
+    case R_READER_START:
+        if (value & 1) {
+            ethmac_tx(s);
+        }
+        break;
+    case R_READER_SLOT:
+    case R_READER_LENGTH0:
+    case R_READER_LENGTH1:
+        s->regs[addr] = value;
+        break;
+    case R_WRITER_SLOT:
+    case R_WRITER_LENGTH0:
+    case R_WRITER_LENGTH1:
+    case R_WRITER_LENGTH2:
+    case R_WRITER_LENGTH3:
+    case R_WRITER_ERRORS0:
+    case R_WRITER_ERRORS1:
+    case R_WRITER_ERRORS2:
+    case R_WRITER_ERRORS3:
+    case R_WRITER_EV_STATUS:
+    case R_READER_READY:
+    case R_READER_EV_STATUS:
+    case R_PREAMBLE_CRC:
+        /* read only */
+        break;
+
+    default:
+        error_report("litex_ethmac: write access to unknown register 0x"
+                TARGET_FMT_plx, addr << 2);
+        break;
+    }
+}
+
+static const MemoryRegionOps ethmac_ops = {
+    .read = ethmac_read,
+    .write = ethmac_write,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static void litex_ethmac_reset(DeviceState *d)
+{
+    LitexEthmacState *s = LITEX_ETHMAC(d);
+    int i;
+
+    for (i = 0; i < R_MAX; i++) {
+        s->regs[i] = 0;
+    }
+    s->rx_head = 0;
+    s->rx_count = 0;
+    s->rx_errors = 0;
+
+    /* the reader never has to wait, preamble and crc are done for us */
+    s->regs[R_READER_READY] = 1;
+    s->regs[R_PREAMBLE_CRC] = 1;
+}
+
+static NetClientInfo net_litex_ethmac_info = {
+    .type = NET_CLIENT_DRIVER_NIC,
+    .size = sizeof(NICState),
+    .can_receive = ethmac_can_rx,
+    .receive = ethmac_rx,
+};
+
+static void litex_ethmac_realize(DeviceState *dev, Error **errp)
+{
+    LitexEthmacState *s = LITEX_ETHMAC(dev);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
+    Error *err = NULL;
+
+    if (!s->rx_slots || s->rx_slots > MAX_SLOTS ||
+        !s->tx_slots || s->tx_slots > MAX_SLOTS) {
+        error_setg(errp, "litex_ethmac: slot counts must be in 1..%d",
+                   MAX_SLOTS);
+        return;
+    }
+
+    memory_region_init_ram(&s->buffers, OBJECT(dev), "litex-ethmac.buffers",
+                           (s->rx_slots + s->tx_slots) * SLOT_SIZE, &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    vmstate_register_ram(&s->buffers, dev);
+    s->buf = memory_region_get_ram_ptr(&s->buffers);
+    sysbus_init_mmio(sbd, &s->buffers);
+
+    qemu_macaddr_default_if_unset(&s->conf.macaddr);
+    s->nic = qemu_new_nic(&net_litex_ethmac_info, &s->conf,
+                          object_get_typename(OBJECT(dev)), dev->id, s);
+    qemu_format_nic_info_str(qemu_get_queue(s->nic), s->conf.macaddr.a);
+}
+
+static void litex_ethmac_init(Object *obj)
+{
+    LitexEthmacState *s = LITEX_ETHMAC(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+
+    sysbus_init_irq(sbd, &s->irq);
+    memory_region_init_io(&s->regs_region, obj, &ethmac_ops, s,
+                          "litex-ethmac", R_MAX * 4);
+    sysbus_init_mmio(sbd, &s->regs_region);
+}
+
+static int litex_ethmac_post_load(void *opaque, int version_id)
+{
+    LitexEthmacState *s = opaque;
+
+    if (s->rx_head >= s->rx_slots || s->rx_count > s->rx_slots) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static const VMStateDescription vmstate_litex_ethmac = {
+    .name = "litex-ethmac",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = litex_ethmac_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, LitexEthmacState, R_MAX),
+        VMSTATE_UINT32(rx_head, LitexEthmacState),
+        VMSTATE_UINT32(rx_count, LitexEthmacState),
+        VMSTATE_UINT32_ARRAY(rx_len, LitexEthmacState, MAX_SLOTS),
+        VMSTATE_UINT32(rx_errors, LitexEthmacState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property litex_ethmac_properties[] = {
+    DEFINE_NIC_PROPERTIES(LitexEthmacState, conf),
+    DEFINE_PROP_UINT32("rx-slots", LitexEthmacState, rx_slots, 2),
+    DEFINE_PROP_UINT32("tx-slots", LitexEthmacState, tx_slots, 2),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void litex_ethmac_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = litex_ethmac_realize;
+    dc->reset = litex_ethmac_reset;
+    dc->vmsd = &vmstate_litex_ethmac;
+    dc->props = litex_ethmac_properties;
+}
+
+static const TypeInfo litex_ethmac_info = {
+    .name          = TYPE_LITEX_ETHMAC,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(LitexEthmacState),
+    .instance_init = litex_ethmac_init,
+    .class_init    = litex_ethmac_class_init,
+};
+
+static void litex_ethmac_register_types(void)
+{
+    type_register_static(&litex_ethmac_info);
+}
+
+type_init(litex_ethmac_register_types)
@@ -0,0 +1,636 @@
+/*
+ *  QEMU model of the LiteSDCard core.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * LiteSDCard is split into five CSR blocks, each mapped on its own:
+ *
+ *   sdphy         card detect, clock divider and initialization
+ *   sdcore        command, response and block geometry
+ *   sdblock2mem   DMA writer, card to memory
+ *   sdmem2block   DMA reader, memory to card
+ *   sdirq         event status/pending/enable
+ *
+ * Commands and responses go through the generic SD card model.  The data
+ * phase of block read and write commands bypasses its byte interface:
+ * the whole multi-block transfer is handed to the block layer as one
+ * asynchronous request which reads into, or writes from, the DMA buffer
+ * directly, so the vCPU keeps running while the host does the I/O.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/hw.h"
+#include "hw/sysbus.h"
+#include "hw/sd/sd.h"
+#include "hw/dma/litex-dma.h"
+#include "exec/address-spaces.h"
+#include "sysemu/block-backend.h"
+#include "sysemu/blockdev.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+#include "trace.h"
+
+enum {
+    R_PHY_CARD_DETECT = 0,
+    R_PHY_CLOCKER_DIVIDER0,
+    R_PHY_CLOCKER_DIVIDER1,
+    R_PHY_INIT_INITIALIZE,
+    R_PHY_DATAW_STATUS,
+    R_PHY_MAX
+};
+
+enum {
+    R_CORE_CMD_ARGUMENT0 = 0,
+    R_CORE_CMD_COMMAND0 = 4,
+    R_CORE_CMD_SEND = 8,
+    R_CORE_CMD_RESPONSE0,
+    R_CORE_CMD_EVENT = R_CORE_CMD_RESPONSE0 + 16,
+    R_CORE_DATA_EVENT,
+    R_CORE_BLOCK_LENGTH0,
+    R_CORE_BLOCK_COUNT0 = R_CORE_BLOCK_LENGTH0 + 2,
+    R_CORE_MAX = R_CORE_BLOCK_COUNT0 + 4
+};
+
+enum {
+    R_IRQ_STATUS = 0,
+    R_IRQ_PENDING,
+    R_IRQ_ENABLE,
+    R_IRQ_MAX
+};
+
+/* CMD_COMMAND fields */
+#define SD_CTL_RESP_MASK        0x03
+#define SD_CTL_RESP_NONE        0
+#define SD_CTL_RESP_SHORT       1
+#define SD_CTL_RESP_LONG        2
+#define SD_CTL_RESP_SHORT_BUSY  3
+#define SD_CTL_DATA_SHIFT       5
+#define SD_CTL_DATA_MASK        0x03
+#define SD_CTL_DATA_NONE        0
+#define SD_CTL_DATA_READ        1
+#define SD_CTL_DATA_WRITE       2
+#define SD_CTL_CMD_SHIFT        8
+
+/* CMD_EVENT and DATA_EVENT */
+#define SD_EV_DONE              (1 << 0)
+#define SD_EV_ERROR             (1 << 1)
+#define SD_EV_TIMEOUT           (1 << 2)
+#define SD_EV_CRC               (1 << 3)
+
+/* sdirq */
+#define SD_IRQ_CARD_DETECT      (1 << 0)
+#define SD_IRQ_SD_TO_MEM_DONE   (1 << 1)
+#define SD_IRQ_MEM_TO_SD_DONE   (1 << 2)
+#define SD_IRQ_CMD_DONE         (1 << 3)
+
+#define TYPE_LITEX_SDCARD "litex-sdcard"
+#define LITEX_SDCARD(obj) \
+    OBJECT_CHECK(LitexSDCardState, (obj), TYPE_LITEX_SDCARD)
+
+struct LitexSDCardState {
+    SysBusDevice parent_obj;
+
+    MemoryRegion phy_region;
+    MemoryRegion core_region;
+    MemoryRegion block2mem_region;
+    MemoryRegion mem2block_region;
+    MemoryRegion irq_region;
+
+    SDState *card;
+    BlockBackend *blk;
+    bool high_capacity;
+    AddressSpace *as;
+
+    /* in-flight data transfer */
+    BlockAIOCB *aiocb;
+    QEMUIOVector qiov;
+    struct iovec iov;
+    LitexDMAChannel *xfer_ch;
+    hwaddr xfer_addr;
+    uint32_t xfer_len;
+    bool xfer_to_mem;
+    bool xfer_bounce;
+    bool xfer_stop;
+
+    uint8_t phy_regs[R_PHY_MAX];
+    uint8_t core_regs[R_CORE_MAX];
+    LitexDMAChannel block2mem;
+    LitexDMAChannel mem2block;
+    uint8_t irq_pending;
+    uint8_t irq_enable;
+    uint8_t last_cmd;
+
+    qemu_irq irq;
+};
+typedef struct LitexSDCardState LitexSDCardState;
+
+static uint32_t core_get_reg32(LitexSDCardState *s, int reg)
+{
+    return (s->core_regs[reg] << 24) | (s->core_regs[reg + 1] << 16) |
+           (s->core_regs[reg + 2] << 8) | s->core_regs[reg + 3];
+}
+
+static uint32_t core_block_length(LitexSDCardState *s)
+{
+    return (s->core_regs[R_CORE_BLOCK_LENGTH0] << 8) |
+           s->core_regs[R_CORE_BLOCK_LENGTH0 + 1];
+}
+
+static bool sdcard_inserted(LitexSDCardState *s)
+{
+    return s->blk && blk_is_inserted(s->blk);
+}
+
+static void sdcard_update_irq(LitexSDCardState *s)
+{
+    qemu_set_irq(s->irq, s->irq_pending & s->irq_enable);
+}
+
+/* put the card state machine back into transfer state */
+static void sdcard_stop_transmission(LitexSDCardState *s)
+{
+    SDRequest req = { .cmd = 12, .arg = 0 };
+    uint8_t response[16];
+
+    sd_do_command(s->card, &req, response);
+}
+
+static void sdcard_xfer_done(LitexSDCardState *s, int ret)
+{
+    uint8_t ev = SD_EV_DONE;
+
+    if (s->xfer_bounce) {
+        if (ret >= 0 && s->xfer_to_mem) {
+            address_space_rw(s->as, s->xfer_addr, MEMTXATTRS_UNSPECIFIED,
+                             s->iov.iov_base, s->xfer_len, true);
+        }
+        qemu_vfree(s->iov.iov_base);
+    } else {
+        address_space_unmap(s->as, s->iov.iov_base, s->xfer_len,
+                            s->xfer_to_mem, s->xfer_len);
+    }
+    qemu_iovec_destroy(&s->qiov);
+    s->aiocb = NULL;
+
+    if (ret < 0) {
+        ev |= SD_EV_ERROR;
+    } else {
+        litex_dma_channel_advance(s->xfer_ch, s->xfer_len);
+    }
+    if (s->xfer_stop) {
+        sdcard_stop_transmission(s);
+    }
+
+    trace_litex_sdcard_xfer_done(ret);
+    s->core_regs[R_CORE_DATA_EVENT] = ev;
+    s->irq_pending |= s->xfer_to_mem ? SD_IRQ_SD_TO_MEM_DONE
+                                     : SD_IRQ_MEM_TO_SD_DONE;
+    sdcard_update_irq(s);
+}
+
+static void sdcard_xfer_cb(void *opaque, int ret)
+{
+    sdcard_xfer_done(opaque, ret);
+}
+
+static void sdcard_start_xfer(LitexSDCardState *s, uint32_t cmd, uint32_t arg,
+                              bool to_mem)
+{
+    LitexDMAChannel *ch = to_mem ? &s->block2mem : &s->mem2block;
+    uint32_t blk_len = core_block_length(s);
+    uint32_t blk_cnt = core_get_reg32(s, R_CORE_BLOCK_COUNT0);
+    uint64_t offset = s->high_capacity ? (uint64_t)arg << 9 : arg;
+    hwaddr maplen;
+    uint32_t len;
+
+    len = MIN(blk_len * blk_cnt, litex_dma_channel_remaining(ch));
+    if (!len || !litex_dma_channel_active(ch) ||
+        offset + len > blk_getlength(s->blk) ||
+        (!to_mem && blk_is_read_only(s->blk))) {
+        s->core_regs[R_CORE_DATA_EVENT] = SD_EV_DONE | SD_EV_ERROR;
+        sdcard_stop_transmission(s);
+        return;
+    }
+
+    s->xfer_ch = ch;
+    s->xfer_addr = litex_dma_channel_addr(ch);
+    s->xfer_len = len;
+    s->xfer_to_mem = to_mem;
+    /*
+     * single block commands and those announced by CMD23 end by
+     * themselves, multiple block ones wait for the guest's CMD12
+     */
+    s->xfer_stop = (cmd == 17 || cmd == 24 || s->last_cmd == 23);
+
+    /* transfer straight from/to guest RAM, bounce anything else */
+    maplen = len;
+    s->iov.iov_base = address_space_map(s->as, s->xfer_addr, &maplen, to_mem);
+    s->xfer_bounce = !s->iov.iov_base || maplen < len;
+    if (s->xfer_bounce) {
+        if (s->iov.iov_base) {
+            address_space_unmap(s->as, s->iov.iov_base, maplen, to_mem, 0);
+        }
+        s->iov.iov_base = qemu_blockalign(blk_bs(s->blk), len);
+        if (!to_mem) {
+            address_space_rw(s->as, s->xfer_addr, MEMTXATTRS_UNSPECIFIED,
+                             s->iov.iov_base, len, false);
+        }
+    }
+    s->iov.iov_len = len;
+    qemu_iovec_init_external(&s->qiov, &s->iov, 1);
+
+    trace_litex_sdcard_xfer(to_mem, offset, s->xfer_addr, len);
+    s->core_regs[R_CORE_DATA_EVENT] = 0;
+    if (to_mem) {
+        s->aiocb = blk_aio_preadv(s->blk, offset, &s->qiov, 0,
+                                  sdcard_xfer_cb, s);
+    } else {
+        s->aiocb = blk_aio_pwritev(s->blk, offset, &s->qiov, 0,
+                                   sdcard_xfer_cb, s);
+    }
+}
+
+static void sdcard_send_command(LitexSDCardState *s)
+{
+    uint32_t command = core_get_reg32(s, R_CORE_CMD_COMMAND0);
+    SDRequest req;
+    uint8_t response[16];
+    int resp_type = command & SD_CTL_RESP_MASK;
+    int data_type = (command >> SD_CTL_DATA_SHIFT) & SD_CTL_DATA_MASK;
+    int len;
+
+    req.cmd = (command >> SD_CTL_CMD_SHIFT) & 0x3f;
+    req.arg = core_get_reg32(s, R_CORE_CMD_ARGUMENT0);
+    req.crc = 0;
+
+    trace_litex_sdcard_command(req.cmd, req.arg);
+
+    if (s->aiocb) {
+        /* the data phase of the previous command is still running */
+        blk_drain(s->blk);
+    }
+
+    memset(&s->core_regs[R_CORE_CMD_RESPONSE0], 0, 16);
+    if (!sdcard_inserted(s)) {
+        s->core_regs[R_CORE_CMD_EVENT] = SD_EV_DONE | SD_EV_TIMEOUT;
+        goto out;
+    }
+
+    len = sd_do_command(s->card, &req, response);
+    if (resp_type != SD_CTL_RESP_NONE && len == 0) {
+        s->core_regs[R_CORE_CMD_EVENT] = SD_EV_DONE | SD_EV_TIMEOUT;
+        goto out;
+    }
+
+    /* responses are right aligned, most significant byte first */
+    memcpy(&s->core_regs[R_CORE_CMD_RESPONSE0 + 16 - len], response, len);
+    s->core_regs[R_CORE_CMD_EVENT] = SD_EV_DONE;
+
+    if (data_type == SD_CTL_DATA_READ &&
+        (req.cmd == 17 || req.cmd == 18)) {
+        sdcard_start_xfer(s, req.cmd, req.arg, true);
+    } else if (data_type == SD_CTL_DATA_WRITE &&
+               (req.cmd == 24 || req.cmd == 25)) {
+        sdcard_start_xfer(s, req.cmd, req.arg, false);
+    } else if (data_type == SD_CTL_DATA_READ) {
+        /* short register reads (SCR, SWITCH_FUNC, ...) go byte by byte */
+        LitexDMAChannel *ch = &s->block2mem;
+        uint32_t blk_len = core_block_length(s);
+        uint8_t byte;
+        uint32_t i;
+
+        for (i = 0; i < blk_len && sd_data_ready(s->card); i++) {
+            byte = sd_read_data(s->card);
+            if (litex_dma_channel_active(ch)) {
+                address_space_rw(s->as, litex_dma_channel_addr(ch),
+                                 MEMTXATTRS_UNSPECIFIED, &byte, 1, true);
+                litex_dma_channel_advance(ch, 1);
+            }
+        }
+        s->core_regs[R_CORE_DATA_EVENT] = SD_EV_DONE;
+        s->irq_pending |= SD_IRQ_SD_TO_MEM_DONE;
+    } else if (data_type == SD_CTL_DATA_WRITE) {
+        s->core_regs[R_CORE_DATA_EVENT] = SD_EV_DONE | SD_EV_ERROR;
+    }
+
+out:
+    /* remember CMD23, but not an ACMD23 */
+    s->last_cmd = s->last_cmd == 55 ? 0 : req.cmd;
+    s->irq_pending |= SD_IRQ_CMD_DONE;
+    sdcard_update_irq(s);
+}
+
+static uint64_t phy_read(void *opaque, hwaddr addr, unsigned size)
+{
+    LitexSDCardState *s = opaque;
+    uint32_t r = 0;
+
+    addr >>= 2;
+    switch (addr) {
+    case R_PHY_CARD_DETECT:
+        /* active low */
+        r = !sdcard_inserted(s);
+        break;
+    case R_PHY_CLOCKER_DIVIDER0:
+    case R_PHY_CLOCKER_DIVIDER1:
+    case R_PHY_INIT_INITIALIZE:
+    case R_PHY_DATAW_STATUS:
+        r = s->phy_regs[addr];
+        break;
+
+    default:
+        error_report("litex_sdcard: read access to unknown phy register 0x"
+                TARGET_FMT_plx, addr << 2);
+        break;
+    }
+
+    return r;
+}
+
+static void phy_write(void *opaque, hwaddr addr, uint64_t value,
+                      unsigned size)
+{
+    LitexSDCardState *s = opaque;
+
+    addr >>= 2;
+    switch (addr) {
+    case R_PHY_CLOCKER_DIVIDER0:
+    case R_PHY_CLOCKER_DIVIDER1:
+        s->phy_regs[addr] = value;
+        break;
+    case R_PHY_INIT_INITIALIZE:
+        /* the 80 initialization clocks are instantaneous here */
+        break;
+    case R_PHY_CARD_DETECT:
+    case R_PHY_DATAW_STATUS:
+        break;
+
+    default:
+        error_report("litex_sdcard: write access to unknown phy register 0x"
+                TARGET_FMT_plx, addr << 2);
+        break;
+    }
+}
+
+static uint64_t core_read(void *opaque, hwaddr addr, unsigned size)
+{
+    LitexSDCardState *s = opaque;
+    uint32_t r = 0;
+
+    addr >>= 2;
+    if (addr < R_CORE_MAX) {
+        r = s->core_regs[addr];
+    } else {
+        error_report("litex_sdcard: read access to unknown core register 0x"
+                TARGET_FMT_plx, addr << 2);
+    }
+
+    return r;
+}
+
+static void core_write(void *opaque, hwaddr addr, uint64_t value,
+                       unsigned size)
+{
+    LitexSDCardState *s = opaque;
+
+    value &= 0xff;
+
+    addr >>= 2;
+    switch (addr) {
+    case R_CORE_CMD_ARGUMENT0 ... R_CORE_CMD_COMMAND0 + 3:
+    case R_CORE_BLOCK_LENGTH0 ... R_CORE_BLOCK_COUNT0 + 3:
+        s->core_regs[addr] = value;
+        break;
+    case R_CORE_CMD_SEND:
+        if (value & 1) {
+            sdcard_send_command(s);
+        }
+        break;
+    case R_CORE_CMD_RESPONSE0 ... R_CORE_DATA_EVENT:
+        /* read-only */
+        break;
+
+    default:
+        error_report("litex_sdcard: write access to unknown core register 0x"
+                TARGET_FMT_plx, addr << 2);
+        break;
+    }
+}
+
+static uint64_t dma_read(void *opaque, hwaddr addr, unsigned size)
+{
+    LitexDMAChannel *ch = opaque;
+
+    addr >>= 2;
+    if (addr >= LITEX_DMA_R_MAX) {
+        error_report("litex_sdcard: read access to unknown dma register 0x"
+                TARGET_FMT_plx, addr << 2);
+        return 0;
+    }
+
+    return litex_dma_channel_read(ch, addr);
+}
+
+static void dma_write(void *opaque, hwaddr addr, uint64_t value,
+                      unsigned size)
+{
+    LitexDMAChannel *ch = opaque;
+
+    addr >>= 2;
+    if (addr >= LITEX_DMA_R_MAX) {
+        error_report("litex_sdcard: write access to unknown dma register 0x"
+                TARGET_FMT_plx, addr << 2);
+        return;
+    }
+
+    /* transfers are started by the data commands, not by the channel */
+    litex_dma_channel_write(ch, addr, value);
+}
+
+static uint64_t irq_read(void *opaque, hwaddr addr, unsigned size)
+{
+    LitexSDCardState *s = opaque;
+    uint32_t r = 0;
+
+    addr >>= 2;
+    switch (addr) {
+    case R_IRQ_STATUS:
+        r = (sdcard_inserted(s) ? SD_IRQ_CARD_DETECT : 0) |
+            (s->block2mem.regs[LITEX_DMA_DONE] ? SD_IRQ_SD_TO_MEM_DONE : 0) |
+            (s->mem2block.regs[LITEX_DMA_DONE] ? SD_IRQ_MEM_TO_SD_DONE : 0) |
+            (s->core_regs[R_CORE_CMD_EVENT] & SD_EV_DONE ?
+             SD_IRQ_CMD_DONE : 0);
+        break;
+    case R_IRQ_PENDING:
+        r = s->irq_pending;
+        break;
+    case R_IRQ_ENABLE:
+        r = s->irq_enable;
+        break;
+
+    default:
+        error_report("litex_sdcard: read access to unknown irq register 0x"
+                TARGET_FMT_plx, addr << 2);
+        break;
+    }
+
+    return r;
+}
+
+static void irq_write(void *opaque, hwaddr addr, uint64_t value,
+                      unsigned size)
+{
+    LitexSDCardState *s = opaque;
+
+    addr >>= 2;
+    switch (addr) {
+    case R_IRQ_PENDING:
+        /* write one to clear */
+        s->irq_pending &= ~value;
+        sdcard_update_irq(s);
+        break;
+    case R_IRQ_ENABLE:
+        s->irq_enable = value;
+        sdcard_update_irq(s);
+        break;
+    case R_IRQ_STATUS:
+        break;
+
+    default:
+        error_report("litex_sdcard: write access to unknown irq register 0x"
+                TARGET_FMT_plx, addr << 2);
+        break;
+    }
+}
+
+#define SDCARD_MMIO_OPS(name)                       \
+static const MemoryRegionOps name##_mmio_ops = {    \
+    .read = name##_read,                            \
+    .write = name##_write,                          \
+    .valid = {                                      \
+        .min_access_size = 4,                       \
+        .max_access_size = 4,                       \
+    },                                              \
+    .endianness = DEVICE_NATIVE_ENDIAN,             \
+}
+
+SDCARD_MMIO_OPS(phy);
+SDCARD_MMIO_OPS(core);
+SDCARD_MMIO_OPS(dma);
+SDCARD_MMIO_OPS(irq);
+
+static void litex_sdcard_reset(DeviceState *d)
+{
+    LitexSDCardState *s = LITEX_SDCARD(d);
+
+    if (s->aiocb) {
+        blk_aio_cancel(s->aiocb);
+    }
+
+    memset(s->phy_regs, 0, sizeof(s->phy_regs));
+    memset(s->core_regs, 0, sizeof(s->core_regs));
+    litex_dma_channel_reset(&s->block2mem);
+    litex_dma_channel_reset(&s->mem2block);
+    s->irq_pending = 0;
+    s->irq_enable = 0;
+    s->last_cmd = 0;
+}
+
+static void litex_sdcard_realize(DeviceState *dev, Error **errp)
+{
+    LitexSDCardState *s = LITEX_SDCARD(dev);
+    DriveInfo *dinfo;
+
+    /* FIXME use a qdev drive property instead of drive_get_next() */
+    dinfo = drive_get_next(IF_SD);
+    s->blk = dinfo ? blk_by_legacy_dinfo(dinfo) : NULL;
+    s->card = sd_init(s->blk, false);
+    if (s->card == NULL) {
+        error_setg(errp, "failed to create the SD card");
+        return;
+    }
+
+    /* the card model switches to block addressing above 1 GiB */
+    s->high_capacity = s->blk && blk_getlength(s->blk) > 0x40000000;
+    s->as = &address_space_memory;
+}
+
+static void litex_sdcard_init(Object *obj)
+{
+    LitexSDCardState *s = LITEX_SDCARD(obj);
+    SysBusDevice *dev = SYS_BUS_DEVICE(obj);
+
+    sysbus_init_irq(dev, &s->irq);
+
+    memory_region_init_io(&s->phy_region, obj, &phy_mmio_ops, s,
+            "litex-sdcard.phy", R_PHY_MAX * 4);
+    sysbus_init_mmio(dev, &s->phy_region);
+    memory_region_init_io(&s->core_region, obj, &core_mmio_ops, s,
+            "litex-sdcard.core", R_CORE_MAX * 4);
+    sysbus_init_mmio(dev, &s->core_region);
+    memory_region_init_io(&s->block2mem_region, obj, &dma_mmio_ops,
+            &s->block2mem, "litex-sdcard.block2mem", LITEX_DMA_R_MAX * 4);
+    sysbus_init_mmio(dev, &s->block2mem_region);
+    memory_region_init_io(&s->mem2block_region, obj, &dma_mmio_ops,
+            &s->mem2block, "litex-sdcard.mem2block", LITEX_DMA_R_MAX * 4);
+    sysbus_init_mmio(dev, &s->mem2block_region);
+    memory_region_init_io(&s->irq_region, obj, &irq_mmio_ops, s,
+            "litex-sdcard.irq", R_IRQ_MAX * 4);
+    sysbus_init_mmio(dev, &s->irq_region);
+}
+
+static const VMStateDescription vmstate_litex_sdcard = {
+    .name = "litex-sdcard",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8_ARRAY(phy_regs, LitexSDCardState, R_PHY_MAX),
+        VMSTATE_UINT8_ARRAY(core_regs, LitexSDCardState, R_CORE_MAX),
+        VMSTATE_STRUCT(block2mem, LitexSDCardState, 1,
+                       vmstate_litex_dma_channel, LitexDMAChannel),
+        VMSTATE_STRUCT(mem2block, LitexSDCardState, 1,
+                       vmstate_litex_dma_channel, LitexDMAChannel),
+        VMSTATE_UINT8(irq_pending, LitexSDCardState),
+        VMSTATE_UINT8(irq_enable, LitexSDCardState),
+        VMSTATE_UINT8(last_cmd, LitexSDCardState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void litex_sdcard_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = litex_sdcard_realize;
+    dc->reset = litex_sdcard_reset;
+    dc->vmsd = &vmstate_litex_sdcard;
+    /* Reason: realize() method uses drive_get_next() */
+    dc->cannot_instantiate_with_device_add_yet = true;
+}
+
+static const TypeInfo litex_sdcard_info = {
+    .name          = TYPE_LITEX_SDCARD,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(LitexSDCardState),
+    .instance_init = litex_sdcard_init,
+    .class_init    = litex_sdcard_class_init,
+};
+
+static void litex_sdcard_register_types(void)
+{
+    type_register_static(&litex_sdcard_info);
+}
+
+type_init(litex_sdcard_register_types)
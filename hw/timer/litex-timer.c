@@ -27,7 +27,7 @@
 #include "sysemu/sysemu.h"
 #include "trace.h"
 #include "qemu/timer.h"
-#include "hw/ptimer.h"
+#include "qemu/host-utils.h"
 #include "qemu/error-report.h"
 
 enum {
@@ -59,17 +59,25 @@ enum {
 #define LITEX_TIMER(obj) \
     OBJECT_CHECK(LitexTimerState, (obj), TYPE_LITEX_TIMER)
 
+#define TIMER_EV_ZERO 1
+
+/*
+ * The counter is not ticked.  While enabled it is described by the
+ * virtual time base_ns at which it held base_count, and VALUE is
+ * computed from QEMU_CLOCK_VIRTUAL when the guest asks for it.  The
+ * QEMUTimer is only armed for the next time the counter reaches zero.
+ */
 struct LitexTimerState {
     SysBusDevice parent_obj;
 
     MemoryRegion regs_region;
 
-    QEMUBH *bh0;
-    
-    ptimer_state *ptimer0;
+    QEMUTimer *timer0;
+
+    int64_t base_ns;
+    uint32_t base_count;
+    uint64_t next_zero;     /* ticks after base_ns of the next zero */
 
-    char old_en;
-    
     uint32_t freq_hz;
 
     uint32_t regs[R_MAX];
@@ -80,6 +88,114 @@ struct LitexTimerState {
 
 typedef struct LitexTimerState LitexTimerState;
 
+static uint32_t timer_get_reg32(LitexTimerState *s, int reg)
+{
+    return (s->regs[reg] << 24) | (s->regs[reg + 1] << 16) |
+           (s->regs[reg + 2] << 8) | s->regs[reg + 3];
+}
+
+static void timer_set_reg32(LitexTimerState *s, int reg, uint32_t val)
+{
+    s->regs[reg] = val >> 24;
+    s->regs[reg + 1] = (val >> 16) & 0xff;
+    s->regs[reg + 2] = (val >> 8) & 0xff;
+    s->regs[reg + 3] = val & 0xff;
+}
+
+static void timer_update_irq(LitexTimerState *s)
+{
+    qemu_set_irq(s->timer0_irq,
+                 s->regs[R_TIMER_EV_PENDING] & s->regs[R_TIMER_EV_ENABLE]);
+}
+
+static int64_t timer_ticks_to_ns(LitexTimerState *s, uint64_t ticks)
+{
+    return muldiv64(ticks, NANOSECONDS_PER_SECOND, s->freq_hz);
+}
+
+static uint64_t timer_elapsed(LitexTimerState *s, int64_t now)
+{
+    if (now <= s->base_ns) {
+        return 0;
+    }
+    return muldiv64(now - s->base_ns, s->freq_hz, NANOSECONDS_PER_SECOND);
+}
+
+/*
+ * Counter value 'ticks' clock cycles after base_ns.  Once it hits zero
+ * the counter is reloaded on the following cycle, so with a non-zero
+ * RELOAD it is periodic with a period of RELOAD + 1 cycles.
+ */
+static uint32_t timer_count_at(LitexTimerState *s, uint64_t ticks)
+{
+    uint32_t reload = timer_get_reg32(s, R_TIMER_RELOAD0);
+    uint64_t period = (uint64_t)reload + 1;
+    uint64_t phase;
+
+    if (ticks <= s->base_count) {
+        return s->base_count - ticks;
+    }
+    if (!reload) {
+        return 0;
+    }
+    phase = (ticks - s->base_count) % period;
+    return phase ? period - phase : 0;
+}
+
+static void timer_arm(LitexTimerState *s)
+{
+    timer_mod(s->timer0, s->base_ns + timer_ticks_to_ns(s, s->next_zero));
+}
+
+/*
+ * (Re)start counting down from 'count' at virtual time 'now'.  A counter
+ * that is already at zero doesn't signal again until it has gone through
+ * a reload.
+ */
+static void timer_start(LitexTimerState *s, int64_t now, uint32_t count)
+{
+    uint32_t reload = timer_get_reg32(s, R_TIMER_RELOAD0);
+
+    s->base_ns = now;
+    s->base_count = count;
+
+    if (count) {
+        s->next_zero = count;
+    } else if (reload) {
+        s->next_zero = (uint64_t)reload + 1;
+    } else {
+        timer_del(s->timer0);
+        return;
+    }
+    timer_arm(s);
+}
+
+/*
+ * Re-anchor a running counter at the current time, so that a RELOAD write
+ * only changes the period from the next zero on.
+ */
+static void timer_write_reload(LitexTimerState *s, int reg, uint32_t value)
+{
+    uint64_t ticks;
+    uint32_t count;
+
+    if (!s->regs[R_TIMER_EN]) {
+        s->regs[reg] = value;
+        return;
+    }
+
+    ticks = timer_elapsed(s, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+    count = timer_count_at(s, ticks);
+
+    /* don't lose a zero whose timer callback hasn't run yet */
+    if (timer_pending(s->timer0) && s->next_zero <= ticks) {
+        s->regs[R_TIMER_EV_PENDING] |= TIMER_EV_ZERO;
+        timer_update_irq(s);
+    }
+
+    s->regs[reg] = value;
+    timer_start(s, s->base_ns + timer_ticks_to_ns(s, ticks), count);
+}
 
 static uint64_t timer_read(void *opaque, hwaddr addr,  unsigned size)
 {
@@ -113,18 +229,16 @@ static uint64_t timer_read(void *opaque, hwaddr addr,  unsigned size)
         break;
     }
 
-    //printf("Read reg %lx val %016x\n", addr * 4, r);
     return r;
 }
 
 static void timer_write(void *opaque, hwaddr addr, uint64_t value,  unsigned size)
 {
     LitexTimerState *s = opaque;
-    unsigned int timval;
+    uint32_t timval;
     
     value = value & 0xff;
     
-    //printf("Write value %08x reg %08x\n", (unsigned int)value, (unsigned int)addr);
     addr >>= 2;
 
     switch (addr) {
@@ -132,46 +246,42 @@ static void timer_write(void *opaque, hwaddr addr, uint64_t value,  unsigned siz
     case R_TIMER_LOAD1:
     case R_TIMER_LOAD2:
     case R_TIMER_LOAD3:
+        s->regs[addr] = value;
+        break;
     case R_TIMER_RELOAD0:
     case R_TIMER_RELOAD1:
     case R_TIMER_RELOAD2:
     case R_TIMER_RELOAD3:
-        s->regs[addr] = value;
+        timer_write_reload(s, addr, value);
         break;
     case R_TIMER_EN:
-        s->old_en = s->regs[addr];
+        if (!value) {
+            timer_del(s->timer0);
+        } else if (!s->regs[R_TIMER_EN]) {
+            /* counting starts from LOAD on the rising edge of EN */
+            timer_start(s, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL),
+                        timer_get_reg32(s, R_TIMER_LOAD0));
+        }
         s->regs[addr] = value;
+        break;
+    case R_TIMER_UPDATE_VALUE:
+        if (s->regs[R_TIMER_EN]) {
+            int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
 
-        if(!value)
-        {
-            ptimer_stop(s->ptimer0);
+            timval = timer_count_at(s, timer_elapsed(s, now));
         } else {
-            /* Make sure we were not at 1 before already */
-            if(!s->old_en)
-            {
-                timval = (s->regs[R_TIMER_LOAD0] << 24) | \
-                    (s->regs[R_TIMER_LOAD1] << 16) |      \
-                    (s->regs[R_TIMER_LOAD2] << 8) |       \
-                    (s->regs[R_TIMER_LOAD3]);
-                ptimer_set_count(s->ptimer0,  timval);
-                ptimer_run(s->ptimer0, 0);
-            }
+            timval = timer_get_reg32(s, R_TIMER_LOAD0);
         }
-        break;
-    case R_TIMER_UPDATE_VALUE:
-        timval = (uint32_t)ptimer_get_count(s->ptimer0) ;
-        s->regs[R_TIMER_VALUE0] = timval >> 24;
-        s->regs[R_TIMER_VALUE1] = (timval >> 16) & 0xff;
-        s->regs[R_TIMER_VALUE2] = (timval >> 8 ) & 0xff;
-        s->regs[R_TIMER_VALUE3] = timval & 0xff;
+        timer_set_reg32(s, R_TIMER_VALUE0, timval);
         break;
     case R_TIMER_EV_PENDING:
-        if(value)
-        {
-            qemu_irq_lower(s->timer0_irq);
-        }
+        /* write one to clear */
+        s->regs[addr] &= ~value;
+        timer_update_irq(s);
+        break;
     case R_TIMER_EV_ENABLE:
         s->regs[addr] = value;
+        timer_update_irq(s);
         break;
         
     default:
@@ -193,31 +303,15 @@ static const MemoryRegionOps timer_mmio_ops = {
 static void timer0_hit(void *opaque)
 {
     LitexTimerState *s = opaque;
-    uint32_t timval;
-    
-    //printf("Timer Hit!\n");
-    ptimer_stop(s->ptimer0);
-    
-    if(s->regs[R_TIMER_EV_ENABLE])
-    {
-        qemu_irq_raise(s->timer0_irq);
-    }
-    
-    if(s->regs[R_TIMER_EN])
-    {        
-        timval = (s->regs[R_TIMER_RELOAD0] << 24) | \
-            (s->regs[R_TIMER_RELOAD1] << 16) |      \
-            (s->regs[R_TIMER_RELOAD2] << 8) |       \
-            (s->regs[R_TIMER_RELOAD3]);
-        
-        ptimer_set_count(s->ptimer0,  timval);
-        if(timval)
-            ptimer_run(s->ptimer0, 0);
-        else
-            ptimer_stop(s->ptimer0);
-    } else {
-        
-        ptimer_stop(s->ptimer0);
+    uint32_t reload = timer_get_reg32(s, R_TIMER_RELOAD0);
+
+    s->regs[R_TIMER_EV_PENDING] |= TIMER_EV_ZERO;
+    timer_update_irq(s);
+
+    /* periodic mode re-arms in place, one-shot just stays at zero */
+    if (reload) {
+        s->next_zero += (uint64_t)reload + 1;
+        timer_arm(s);
     }
 }
 
@@ -230,9 +324,10 @@ static void litex_timer_reset(DeviceState *d)
     for (i = 0; i < R_MAX; i++) {
         s->regs[i] = 0;
     }
-    s->old_en = 0;
-    ptimer_stop(s->ptimer0);
-
+    s->base_ns = 0;
+    s->base_count = 0;
+    s->next_zero = 0;
+    timer_del(s->timer0);
 }
 
 static void litex_timer_init(Object *obj)
@@ -241,8 +336,7 @@ static void litex_timer_init(Object *obj)
     SysBusDevice *dev = SYS_BUS_DEVICE(obj);
 
     sysbus_init_irq(dev, &s->timer0_irq);
-    s->bh0 = qemu_bh_new(timer0_hit, s);
-    s->ptimer0 = ptimer_init(s->bh0, PTIMER_POLICY_DEFAULT);
+    s->timer0 = timer_new_ns(QEMU_CLOCK_VIRTUAL, timer0_hit, s);
     memory_region_init_io(&s->regs_region, obj, &timer_mmio_ops, s,  "litex-timer", R_MAX * 4);
     sysbus_init_mmio(dev, &s->regs_region);
 }
@@ -251,20 +345,24 @@ static void litex_timer_realize(DeviceState *dev, Error **errp)
 {
     LitexTimerState *s = LITEX_TIMER(dev);
 
-    ptimer_set_freq(s->ptimer0, s->freq_hz);
+    if (!s->freq_hz) {
+        error_setg(errp, "litex_timer: frequency must not be zero");
+    }
 }
 
 static const VMStateDescription vmstate_litex_timer = {
     .name = "litex-timer",
-    .version_id = 1,
-    .minimum_version_id = 1,
+    .version_id = 2,
+    .minimum_version_id = 2,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, LitexTimerState, R_MAX),
-        VMSTATE_PTIMER(ptimer0, LitexTimerState),
+        VMSTATE_TIMER_PTR(timer0, LitexTimerState),
+        VMSTATE_INT64(base_ns, LitexTimerState),
+        VMSTATE_UINT32(base_count, LitexTimerState),
+        VMSTATE_UINT64(next_zero, LitexTimerState),
         VMSTATE_END_OF_LIST()
     }
 };
-
 static Property litex_timer_properties[] = {
     DEFINE_PROP_UINT32("frequency", LitexTimerState,
     freq_hz, 80000000),
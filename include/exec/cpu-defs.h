@@ -28,6 +28,7 @@
 #include "tcg-target.h"
 #ifndef CONFIG_USER_ONLY
 #include "exec/hwaddr.h"
+#include "qemu/thread.h"
 #endif
 #include "exec/memattrs.h"
 
@@ -64,6 +65,24 @@ typedef uint64_t target_ulong;
 #define CPU_TLB_ENTRY_BITS 5
 #endif
 
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* The TLB of each MMU mode is allocated at run time, and resized when it
+ * is flushed depending on how much of it the guest used (see cputlb.c).
+ * The TCG backend loads its mask from env->tlb_mask[mmu_idx].
+ */
+#define CPU_TLB_DYN_MIN_BITS 6
+#define CPU_TLB_DYN_DEFAULT_BITS 8
+
+#if HOST_LONG_BITS == 32
+/* Make sure we do not require a double-word shift for the TLB load */
+#define CPU_TLB_DYN_MAX_BITS (32 - TARGET_PAGE_BITS)
+#else
+#define CPU_TLB_DYN_MAX_BITS                                    \
+    MIN(22, TARGET_VIRT_ADDR_SPACE_BITS - TARGET_PAGE_BITS)
+#endif
+
+#else /* !TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
 /* TCG_TARGET_TLB_DISPLACEMENT_BITS is used in CPU_TLB_BITS to ensure that
  * the TLB is not unnecessarily small, but still small enough for the
  * TLB lookup instruction sequence used by the TCG target.
@@ -96,6 +115,8 @@ typedef uint64_t target_ulong;
 
 #define CPU_TLB_SIZE (1 << CPU_TLB_BITS)
 
+#endif /* TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
 typedef struct CPUTLBEntry {
     /* bit TARGET_LONG_BITS to TARGET_PAGE_BITS : virtual address
        bit TARGET_PAGE_BITS-1..4  : Nonzero for accesses that should not
@@ -129,12 +150,40 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+typedef struct CPUTLBDesc {
+    /* Start of the current resize window, and the largest number of
+     * entries seen in use at a flush during it.
+     */
+    int64_t window_begin_ns;
+    size_t window_max_entries;
+    /* Number of valid entries in tlb_table.  */
+    size_t n_used_entries;
+} CPUTLBDesc;
+
+#define CPU_COMMON_TLB_TABLES                                           \
+    CPUTLBDesc tlb_d[NB_MMU_MODES];                                     \
+    /* (number of entries - 1) << CPU_TLB_ENTRY_BITS */                 \
+    uintptr_t tlb_mask[NB_MMU_MODES];                                   \
+    CPUTLBEntry *tlb_table[NB_MMU_MODES];                               \
+    CPUIOTLBEntry *iotlb[NB_MMU_MODES];                                 \
+
+#else
+
+#define CPU_COMMON_TLB_TABLES                                           \
+    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
+    CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];                    \
+
+#endif
+
 #define CPU_COMMON_TLB \
     /* The meaning of the MMU modes is defined in the target code. */   \
-    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
+    CPU_COMMON_TLB_TABLES                                               \
     CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
-    CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];                    \
     CPUIOTLBEntry iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];                 \
+    /* Taken by other threads walking the TLB, which must not see    \
+       tlb_table and iotlb being resized.  */                           \
+    QemuSpin tlb_lock;                                                  \
     target_ulong tlb_flush_addr;                                        \
     target_ulong tlb_flush_mask;                                        \
     target_ulong vtlb_index;                                            \
@@ -56,6 +56,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags,
                               int cflags);
+TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
+                                   target_ulong cs_base, uint32_t flags);
 
 void QEMU_NORETURN cpu_loop_exit(CPUState *cpu);
 void QEMU_NORETURN cpu_loop_exit_restore(CPUState *cpu, uintptr_t pc);
@@ -83,6 +85,18 @@ void cpu_reloading_memory_map(void);
  */
 void cpu_address_space_init(CPUState *cpu, AddressSpace *as, int asidx);
 /* cputlb.c */
+/**
+ * tlb_init:
+ * @cpu: CPU whose TLB should be initialized
+ *
+ * Allocate the TLB of @cpu.  Called when the CPU is realized.
+ */
+void tlb_init(CPUState *cpu);
+/**
+ * tlb_destroy:
+ * @cpu: CPU whose TLB should be freed
+ */
+void tlb_destroy(CPUState *cpu);
 /**
  * tlb_flush_page:
  * @cpu: CPU whose TLB should be flushed
@@ -123,6 +137,43 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, ...);
  * MMU indexes.
  */
 void tlb_flush_by_mmuidx(CPUState *cpu, ...);
+/**
+ * tlb_flush_all_cpus_synced:
+ * @src_cpu: CPU issuing the flush
+ * @flush_global: ignored
+ *
+ * Flush the entire TLB of every CPU.  The flush has completed on all
+ * CPUs before @src_cpu executes another guest instruction; with MTTCG
+ * this needs the caller to end the TB.
+ */
+void tlb_flush_all_cpus_synced(CPUState *src_cpu, int flush_global);
+/**
+ * tlb_flush_by_mmuidx_all_cpus_synced:
+ * @src_cpu: CPU issuing the flush
+ * @...: list of MMU indexes to flush, terminated by a negative value
+ *
+ * Like tlb_flush_all_cpus_synced(), for the specified MMU indexes.
+ */
+void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu, ...);
+/**
+ * tlb_flush_page_all_cpus_synced:
+ * @src_cpu: CPU issuing the flush
+ * @addr: virtual address of page to be flushed
+ *
+ * Like tlb_flush_all_cpus_synced(), for one page.
+ */
+void tlb_flush_page_all_cpus_synced(CPUState *src_cpu, target_ulong addr);
+/**
+ * tlb_flush_page_by_mmuidx_all_cpus_synced:
+ * @src_cpu: CPU issuing the flush
+ * @addr: virtual address of page to be flushed
+ * @...: list of MMU indexes to flush, terminated by a negative value
+ *
+ * Like tlb_flush_all_cpus_synced(), for one page and the specified
+ * MMU indexes.
+ */
+void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                              target_ulong addr, ...);
 /**
  * tlb_set_page_with_attrs:
  * @cpu: CPU to add this TLB entry for
@@ -177,6 +228,26 @@ static inline void tlb_flush_page_by_mmuidx(CPUState *cpu,
 static inline void tlb_flush_by_mmuidx(CPUState *cpu, ...)
 {
 }
+
+static inline void tlb_flush_all_cpus_synced(CPUState *src_cpu,
+                                             int flush_global)
+{
+}
+
+static inline void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu, ...)
+{
+}
+
+static inline void tlb_flush_page_all_cpus_synced(CPUState *src_cpu,
+                                                  target_ulong addr)
+{
+}
+
+static inline void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                                            target_ulong addr,
+                                                            ...)
+{
+}
 #endif
 
 #define CODE_GEN_ALIGN           16 /* must be >= of the size of a icache line */
@@ -215,6 +286,8 @@ struct TranslationBlock {
 #define CF_IGNORE_ICOUNT 0x40000 /* Do not generate icount code */
 
     uint16_t invalid;
+    /* set when looked up since the last eviction, see do_tb_evict() */
+    uint16_t touched;
 
     void *tc_ptr;    /* pointer to the translated code */
     uint8_t *tc_search;  /* pointer to search data */
@@ -0,0 +1,44 @@
+/*
+ * Persistent translation block cache
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef EXEC_TB_CACHE_H
+#define EXEC_TB_CACHE_H
+
+#include "exec/exec-all.h"
+
+#ifndef CONFIG_USER_ONLY
+void tb_cache_init(const char *path, Error **errp);
+
+/* Whether TBs with CFLAGS translated for CPU may be loaded and recorded.  */
+bool tb_cache_enabled(CPUState *cpu, uint32_t cflags);
+
+bool tb_cache_load(CPUState *cpu, TranslationBlock *tb,
+                   tb_page_addr_t phys_pc, int *code_size, int *search_size);
+void tb_cache_record(TranslationBlock *tb, tb_page_addr_t phys_pc,
+                     int code_size, int search_size);
+void tb_cache_dump_info(FILE *f, fprintf_function cpu_fprintf);
+#else
+static inline bool tb_cache_enabled(CPUState *cpu, uint32_t cflags)
+{
+    return false;
+}
+
+static inline bool tb_cache_load(CPUState *cpu, TranslationBlock *tb,
+                                 tb_page_addr_t phys_pc, int *code_size,
+                                 int *search_size)
+{
+    return false;
+}
+
+static inline void tb_cache_record(TranslationBlock *tb,
+                                   tb_page_addr_t phys_pc,
+                                   int code_size, int search_size)
+{
+}
+#endif
+
+#endif
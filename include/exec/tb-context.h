@@ -26,19 +26,42 @@
 #define CODE_GEN_HTABLE_BITS     15
 #define CODE_GEN_HTABLE_SIZE     (1 << CODE_GEN_HTABLE_BITS)
 
+#define CODE_GEN_REGIONS         8
+
 typedef struct TranslationBlock TranslationBlock;
+typedef struct TBRegion TBRegion;
 typedef struct TBContext TBContext;
 
+/* A slice of the code buffer and of the TB array.  Code is generated into
+ * one region at a time; when it fills up, the next region whose TBs have
+ * not been running much, usually the oldest one, is evicted and reused.
+ */
+struct TBRegion {
+    void *buf;
+    void *end;
+    /* end of the generated code, except for the current region where it
+       is tcg_ctx.code_gen_ptr */
+    void *ptr;
+    TranslationBlock *tbs;
+    int max_tbs;
+    int nb_tbs;
+};
+
 struct TBContext {
 
     TranslationBlock *tbs;
     struct qht htable;
+    /* number of TBs in all regions */
     int nb_tbs;
+    TBRegion regions[CODE_GEN_REGIONS];
+    int region;
     /* any access to the tbs or the page table must use this lock */
     QemuMutex tb_lock;
 
     /* statistics */
     unsigned tb_flush_count;
+    unsigned tb_evict_count;
+    unsigned tb_evicted_tbs;
     int tb_phys_invalidate_count;
 };
 
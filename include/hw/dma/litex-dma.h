@@ -0,0 +1,42 @@
+#ifndef HW_DMA_LITEX_DMA_H
+#define HW_DMA_LITEX_DMA_H
+
+#include "exec/hwaddr.h"
+#include "migration/vmstate.h"
+
+/*
+ * CSRs of one LiteX WishboneDMAReader/WishboneDMAWriter channel on an
+ * 8-bit CSR bus, multi-byte values most significant byte first.  Devices
+ * with DMA of their own (LiteSDCard, ...) embed a LitexDMAChannel and
+ * forward accesses to its register range.
+ */
+enum {
+    LITEX_DMA_BASE0 = 0,        /* 64-bit bus address */
+    LITEX_DMA_LENGTH0 = 8,      /* 32-bit length in bytes */
+    LITEX_DMA_ENABLE = 12,
+    LITEX_DMA_DONE,
+    LITEX_DMA_LOOP,
+    LITEX_DMA_OFFSET0,          /* 32-bit current offset, read-only */
+    LITEX_DMA_R_MAX = LITEX_DMA_OFFSET0 + 4
+};
+
+typedef struct LitexDMAChannel {
+    uint8_t regs[LITEX_DMA_R_MAX];
+    uint32_t offset;
+} LitexDMAChannel;
+
+extern const VMStateDescription vmstate_litex_dma_channel;
+
+void litex_dma_channel_reset(LitexDMAChannel *ch);
+uint32_t litex_dma_channel_read(LitexDMAChannel *ch, unsigned reg);
+/* returns true if the write started a transfer */
+bool litex_dma_channel_write(LitexDMAChannel *ch, unsigned reg,
+                             uint32_t value);
+
+bool litex_dma_channel_active(LitexDMAChannel *ch);
+hwaddr litex_dma_channel_addr(LitexDMAChannel *ch);
+uint32_t litex_dma_channel_remaining(LitexDMAChannel *ch);
+/* returns true if this completed the transfer */
+bool litex_dma_channel_advance(LitexDMAChannel *ch, uint32_t len);
+
+#endif
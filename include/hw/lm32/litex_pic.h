@@ -3,9 +3,11 @@
 
 #include "qemu-common.h"
 
+#define LITEX_PIC_LATENCY_BUCKETS 16
+
 uint32_t litex_pic_get_ip(DeviceState *d);
 uint32_t litex_pic_get_im(DeviceState *d);
 void litex_pic_set_ip(DeviceState *d, uint32_t ip);
 void litex_pic_set_im(DeviceState *d, uint32_t im);
 
-#endif /* QEMU_HW_LM32_PIC_H */
+#endif /* QEMU_HW_LITEX_PIC_H */
@@ -2,6 +2,29 @@
 #define QEMU_HW_LM32_PIC_H
 
 #include "qemu-common.h"
+#include "qom/object.h"
+
+/*
+ * Interrupt controllers the LM32 CPU can use for its IM/IP CSRs.  The
+ * lm32_pic_*() accessors below dispatch through this interface, so
+ * env->pic_state may point to any device implementing it.
+ */
+#define TYPE_LM32_PIC_INTERFACE "lm32-pic-interface"
+
+#define LM32_PIC_INTERFACE_CLASS(klass) \
+    OBJECT_CLASS_CHECK(LM32PicInterfaceClass, (klass), \
+                       TYPE_LM32_PIC_INTERFACE)
+#define LM32_PIC_INTERFACE_GET_CLASS(obj) \
+    OBJECT_GET_CLASS(LM32PicInterfaceClass, (obj), TYPE_LM32_PIC_INTERFACE)
+
+typedef struct LM32PicInterfaceClass {
+    InterfaceClass parent;
+
+    uint32_t (*get_ip)(DeviceState *d);
+    uint32_t (*get_im)(DeviceState *d);
+    void (*set_ip)(DeviceState *d, uint32_t ip);
+    void (*set_im)(DeviceState *d, uint32_t im);
+} LM32PicInterfaceClass;
 
 uint32_t lm32_pic_get_ip(DeviceState *d);
 uint32_t lm32_pic_get_im(DeviceState *d);
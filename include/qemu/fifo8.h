@@ -68,6 +68,19 @@ void fifo8_push_all(Fifo8 *fifo, const uint8_t *data, uint32_t num);
 
 uint8_t fifo8_pop(Fifo8 *fifo);
 
+/**
+ * fifo8_peek:
+ * @fifo: fifo to peek from
+ *
+ * Return the data byte at the head of the FIFO without removing it.
+ * Behaviour is undefined if the FIFO is empty. Clients are responsible
+ * for checking for emptyness using fifo8_is_empty().
+ *
+ * Returns: The data byte at the head of the FIFO.
+ */
+
+uint8_t fifo8_peek(Fifo8 *fifo);
+
 /**
  * fifo8_pop_buf:
  * @fifo: FIFO to pop from
@@ -149,12 +162,16 @@ uint32_t fifo8_num_used(Fifo8 *fifo);
 
 extern const VMStateDescription vmstate_fifo8;
 
-#define VMSTATE_FIFO8(_field, _state) {                              \
+#define VMSTATE_FIFO8_V(_field, _state, _version) {                  \
     .name       = (stringify(_field)),                               \
+    .version_id = (_version),                                        \
     .size       = sizeof(Fifo8),                                     \
     .vmsd       = &vmstate_fifo8,                                    \
     .flags      = VMS_STRUCT,                                        \
     .offset     = vmstate_offset_value(_state, _field, Fifo8),       \
 }
 
+#define VMSTATE_FIFO8(_field, _state)                                \
+    VMSTATE_FIFO8_V(_field, _state, 0)
+
 #endif /* QEMU_FIFO8_H */
@@ -627,6 +627,16 @@ static inline bool cpu_has_work(CPUState *cpu)
  */
 bool qemu_cpu_is_self(CPUState *cpu);
 
+/**
+ * qemu_tcg_mttcg_enabled:
+ *
+ * Checks whether TCG runs each vCPU on its own host thread.
+ *
+ * Returns: %true in multi-threaded TCG mode, %false otherwise.
+ */
+extern bool mttcg_enabled;
+#define qemu_tcg_mttcg_enabled() (mttcg_enabled)
+
 /**
  * qemu_cpu_kick:
  * @cpu: The vCPU to kick.
@@ -0,0 +1,21 @@
+/*
+ * In-memory machine snapshots
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef SYSEMU_MEMSNAP_H
+#define SYSEMU_MEMSNAP_H
+
+#include "exec/memory.h"
+
+/*
+ * Like memory_region_allocate_system_memory(), but back the RAM with a
+ * memfd mapped copy-on-write, so that memsnap-load can revert it to the
+ * last memsnap-save by dropping the private pages.
+ */
+void memsnap_allocate_system_memory(MemoryRegion *mr, Object *owner,
+                                    const char *name, uint64_t ram_size);
+
+#endif
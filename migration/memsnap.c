@@ -0,0 +1,261 @@
+/*
+ * In-memory machine snapshots
+ *
+ * memsnap-save records the whole machine in memory and memsnap-load goes
+ * back to it, as often as needed, so a test runner can boot once and then
+ * start every test from the same state.
+ *
+ * RAM allocated with memsnap_allocate_system_memory() lives in a memfd
+ * which holds the snapshot image; the guest runs on a MAP_PRIVATE mapping
+ * of it.  Saving copies guest RAM into the image, loading just discards
+ * the private (written) pages of the mapping, which is proportional to
+ * what the guest touched since, not to the size of RAM.  Other RAM blocks
+ * (ROMs, device buffers) are small and copied.  Device and CPU state go
+ * through qemu_save_device_state() into a memory buffer, without RAM.
+ *
+ * Block devices are not part of the snapshot.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qerror.h"
+#include "qemu/error-report.h"
+#include "qemu/memfd.h"
+#include "qemu/queue.h"
+#include "qom/cpu.h"
+#include "exec/exec-all.h"
+#include "exec/ram_addr.h"
+#include "migration/migration.h"
+#include "io/channel-buffer.h"
+#include "sysemu/sysemu.h"
+#include "sysemu/memsnap.h"
+#include "qmp-commands.h"
+#include "trace.h"
+
+typedef struct MemsnapRAM {
+    MemoryRegion *mr;
+    void *host;                 /* private mapping the guest runs on */
+    void *image;                /* shared mapping, the snapshot */
+    uint64_t size;
+    int fd;
+    QLIST_ENTRY(MemsnapRAM) next;
+} MemsnapRAM;
+
+typedef struct MemsnapCopy {
+    ram_addr_t offset;
+    void *host;
+    void *data;
+    ram_addr_t size;
+} MemsnapCopy;
+
+static struct {
+    QLIST_HEAD(, MemsnapRAM) ram;
+    GArray *copies;
+    uint8_t *devices;
+    size_t devices_size;
+} memsnap;
+
+void memsnap_allocate_system_memory(MemoryRegion *mr, Object *owner,
+                                    const char *name, uint64_t ram_size)
+{
+#ifdef CONFIG_POSIX
+    MemsnapRAM *r = g_new0(MemsnapRAM, 1);
+
+    r->image = qemu_memfd_alloc(name, ram_size, 0, &r->fd);
+    if (!r->image) {
+        error_report("memsnap: cannot allocate %" PRIu64 " bytes for '%s'",
+                     ram_size, name);
+        exit(1);
+    }
+    r->host = mmap(NULL, ram_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   r->fd, 0);
+    if (r->host == MAP_FAILED) {
+        error_report("memsnap: cannot map '%s': %s", name, strerror(errno));
+        exit(1);
+    }
+    r->size = ram_size;
+    r->mr = mr;
+    QLIST_INSERT_HEAD(&memsnap.ram, r, next);
+
+    memory_region_init_ram_ptr(mr, owner, name, ram_size, r->host);
+    vmstate_register_ram_global(mr);
+#else
+    memory_region_allocate_system_memory(mr, owner, name, ram_size);
+#endif
+}
+
+/* drop the private pages, the mapping shows the image again */
+static void memsnap_discard(MemsnapRAM *r)
+{
+#ifdef CONFIG_POSIX
+    void *host;
+
+    host = mmap(r->host, r->size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_FIXED, r->fd, 0);
+    if (host == MAP_FAILED) {
+        error_report("memsnap: cannot remap RAM: %s", strerror(errno));
+        abort();
+    }
+#endif
+}
+
+static MemsnapRAM *memsnap_find_ram(void *host)
+{
+    MemsnapRAM *r;
+
+    QLIST_FOREACH(r, &memsnap.ram, next) {
+        if (r->host == host) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+static int memsnap_copy_block(const char *block_name, void *host_addr,
+                              ram_addr_t offset, ram_addr_t length,
+                              void *opaque)
+{
+    MemsnapCopy c;
+
+    if (memsnap_find_ram(host_addr)) {
+        return 0;
+    }
+
+    c.offset = offset;
+    c.host = host_addr;
+    c.data = g_memdup(host_addr, length);
+    c.size = length;
+    g_array_append_val(memsnap.copies, c);
+    return 0;
+}
+
+static void memsnap_free_copies(void)
+{
+    int i;
+
+    for (i = 0; i < memsnap.copies->len; i++) {
+        g_free(g_array_index(memsnap.copies, MemsnapCopy, i).data);
+    }
+    g_array_set_size(memsnap.copies, 0);
+}
+
+void qmp_memsnap_save(Error **errp)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    MemsnapRAM *r;
+    int saved_vm_running;
+    int ret;
+
+    if (QLIST_EMPTY(&memsnap.ram)) {
+        error_setg(errp, "The machine has no RAM that supports in-memory "
+                   "snapshots");
+        return;
+    }
+
+    saved_vm_running = runstate_is_running();
+    vm_stop(RUN_STATE_SAVE_VM);
+    global_state_store_running();
+
+    bioc = qio_channel_buffer_new(64 * 1024);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "memsnap-save-buffer");
+    f = qemu_fopen_channel_output(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    ret = qemu_save_device_state(f);
+    qemu_fflush(f);
+    if (ret < 0) {
+        error_setg(errp, QERR_IO_ERROR);
+        qemu_fclose(f);
+        goto out;
+    }
+    g_free(memsnap.devices);
+    memsnap.devices = g_memdup(bioc->data, bioc->usage);
+    memsnap.devices_size = bioc->usage;
+    qemu_fclose(f);
+
+    if (!memsnap.copies) {
+        memsnap.copies = g_array_new(false, false, sizeof(MemsnapCopy));
+    }
+    memsnap_free_copies();
+    qemu_ram_foreach_block(memsnap_copy_block, NULL);
+
+    QLIST_FOREACH(r, &memsnap.ram, next) {
+        /* pages the guest never wrote already are the image */
+        memcpy(r->image, r->host, r->size);
+        memsnap_discard(r);
+    }
+
+    trace_memsnap_save(memsnap.devices_size, memsnap.copies->len);
+
+out:
+    if (saved_vm_running) {
+        vm_start();
+    }
+}
+
+void qmp_memsnap_load(Error **errp)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    MemsnapRAM *r;
+    CPUState *cpu;
+    int saved_vm_running;
+    int i, ret;
+
+    if (!memsnap.devices) {
+        error_setg(errp, "No in-memory snapshot has been saved");
+        return;
+    }
+
+    saved_vm_running = runstate_is_running();
+    vm_stop(RUN_STATE_RESTORE_VM);
+
+    /* the rom loader rewrites its blobs on reset, so reset first */
+    qemu_system_reset(VMRESET_SILENT);
+
+    QLIST_FOREACH(r, &memsnap.ram, next) {
+        memsnap_discard(r);
+        cpu_physical_memory_set_dirty_range(memory_region_get_ram_addr(r->mr),
+                                            r->size, DIRTY_CLIENTS_ALL);
+    }
+    for (i = 0; i < memsnap.copies->len; i++) {
+        MemsnapCopy *c = &g_array_index(memsnap.copies, MemsnapCopy, i);
+
+        memcpy(c->host, c->data, c->size);
+        cpu_physical_memory_set_dirty_range(c->offset, c->size,
+                                            DIRTY_CLIENTS_ALL);
+    }
+
+    /* RAM changed behind the back of the translator and the TLBs */
+    CPU_FOREACH(cpu) {
+        tlb_flush(cpu, 1);
+    }
+    if (first_cpu) {
+        tb_flush(first_cpu);
+    }
+
+    bioc = qio_channel_buffer_new(memsnap.devices_size);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "memsnap-load-buffer");
+    memcpy(bioc->data, memsnap.devices, memsnap.devices_size);
+    bioc->usage = memsnap.devices_size;
+    f = qemu_fopen_channel_input(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    ret = qemu_load_device_state(f);
+    qemu_fclose(f);
+    if (ret < 0) {
+        error_setg(errp, "Error %d while loading the device state", ret);
+        return;
+    }
+
+    trace_memsnap_load(memsnap.devices_size);
+
+    if (saved_vm_running) {
+        vm_start();
+    }
+}
@@ -1238,7 +1238,7 @@ done:
     return ret;
 }
 
-static int qemu_save_device_state(QEMUFile *f)
+int qemu_save_device_state(QEMUFile *f)
 {
     SaveStateEntry *se;
 
@@ -2013,6 +2013,29 @@ int qemu_loadvm_state(QEMUFile *f)
     return ret;
 }
 
+/* Load a stream written by qemu_save_device_state() */
+int qemu_load_device_state(QEMUFile *f)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    int ret;
+
+    if (qemu_get_be32(f) != QEMU_VM_FILE_MAGIC ||
+        qemu_get_be32(f) != QEMU_VM_FILE_VERSION) {
+        error_report("Not a device state stream");
+        return -EINVAL;
+    }
+
+    ret = qemu_loadvm_state_main(f, mis);
+    if (ret == 0) {
+        ret = qemu_file_get_error(f);
+    }
+    if (ret == 0) {
+        cpu_synchronize_all_post_init();
+    }
+
+    return ret;
+}
+
 void hmp_savevm(Monitor *mon, const QDict *qdict)
 {
     BlockDriverState *bs, *bs1;
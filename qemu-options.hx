@@ -96,6 +96,31 @@ STEXI
 Select CPU model (@code{-cpu help} for list and additional feature selection)
 ETEXI
 
+DEF("accel", HAS_ARG, QEMU_OPTION_accel,
+    "-accel [accel=]accelerator[,thread=single|multi][,tb-cache=file]\n"
+    "                select accelerator (kvm, xen or tcg; use 'help' for a list)\n"
+    "                thread=single|multi (enable multi-threaded TCG)\n"
+    "                tb-cache=file (reuse translated code across runs)\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -accel @var{name}[,prop=@var{value}[,...]]
+@findex -accel
+This is used to enable an accelerator. Depending on the target architecture,
+kvm, xen, or tcg can be available. By default, tcg is used.
+@table @option
+@item thread=single|multi
+Controls the number of TCG threads. With @code{multi} every vCPU runs on its
+own host thread, taking advantage of additional host cores. This needs a
+guest that supports it and is incompatible with @option{-icount}. The
+default is @code{single}.
+@item tb-cache=@var{file}
+Keep the code generated by TCG in @var{file} when QEMU exits, and reuse it
+in the next runs for guest code that has not changed, instead of
+translating it again. The file is only reused by the same QEMU binary with
+the same CPU model. This needs a host and a guest that support it.
+@end table
+ETEXI
+
 DEF("smp", HAS_ARG, QEMU_OPTION_smp,
     "-smp [cpus=]n[,maxcpus=cpus][,cores=cores][,threads=threads][,sockets=sockets]\n"
     "                set the number of CPUs to 'n' [default=1]\n"
@@ -0,0 +1,85 @@
+#!/usr/bin/env python
+#
+# Build a fast-forward boot image for the litex machine
+#
+# Memory is taken from raw dumps, e.g. made with the "pmemsave" monitor
+# command once the bios has finished, and CPU registers are given on the
+# command line (see "info registers"), including the interrupt mask if the
+# system runs with interrupts enabled.  All-zero pages are left out.
+#
+# Example:
+#   litex-ffboot.py -o boot.img --pc 0x40000000 \
+#       --mem 0x10000000:sram.bin --mem 0x40000000:main_ram.bin r1=0x1000
+#
+#   qemu-system-lm32 -M litex,boot-state=boot.img ...
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+
+import argparse
+import struct
+import sys
+
+MAGIC = b'LXFFBOOT'
+VERSION = 2
+PAGE_SIZE = 4096
+
+
+def parse_int(s):
+    return int(s, 0)
+
+
+def chunks(base, data):
+    """Yield (addr, bytes) for each run of non-zero pages in data."""
+    start = None
+    for off in range(0, len(data), PAGE_SIZE):
+        page = data[off:off + PAGE_SIZE]
+        if page.count(b'\0') == len(page):
+            if start is not None:
+                yield base + start, data[start:off]
+                start = None
+        elif start is None:
+            start = off
+    if start is not None:
+        yield base + start, data[start:]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build a litex boot-state image')
+    parser.add_argument('-o', '--output', required=True)
+    parser.add_argument('--pc', type=parse_int, required=True)
+    parser.add_argument('--ie', type=parse_int, default=0)
+    parser.add_argument('--im', type=parse_int, default=0)
+    parser.add_argument('--eba', type=parse_int, default=0)
+    parser.add_argument('--deba', type=parse_int, default=0)
+    parser.add_argument('--mem', action='append', default=[],
+                        metavar='ADDR:FILE', help='raw memory dump at ADDR')
+    parser.add_argument('regs', nargs='*', metavar='rN=VALUE')
+    args = parser.parse_args()
+
+    regs = [0] * 32
+    for r in args.regs:
+        name, value = r.split('=', 1)
+        if not name.startswith('r'):
+            sys.exit('bad register assignment: %s' % r)
+        regs[int(name[1:])] = parse_int(value)
+
+    out = []
+    for m in args.mem:
+        addr, filename = m.split(':', 1)
+        with open(filename, 'rb') as f:
+            out.extend(chunks(parse_int(addr), f.read()))
+
+    with open(args.output, 'wb') as f:
+        f.write(MAGIC)
+        f.write(struct.pack('<6I', VERSION, args.pc, args.ie, args.im,
+                            args.eba, args.deba))
+        f.write(struct.pack('<32I', *regs))
+        f.write(struct.pack('<I', len(out)))
+        for addr, data in out:
+            f.write(struct.pack('<II', addr, len(data)))
+            f.write(data)
+
+
+if __name__ == '__main__':
+    main()
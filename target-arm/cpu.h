@@ -31,6 +31,11 @@
 
 #define CPUArchState struct CPUARMState
 
+/* Exclusives and barriers are TCG ops and ARM_CP_IO registers take the
+ * BQL, so vCPUs may run on their own threads (-accel tcg,thread=multi).
+ */
+#define TARGET_SUPPORTS_MTTCG
+
 #include "qemu-common.h"
 #include "cpu-qom.h"
 #include "exec/cpu-defs.h"
@@ -491,6 +496,9 @@ typedef struct CPUARMState {
     struct CPUBreakpoint *cpu_breakpoint[16];
     struct CPUWatchpoint *cpu_watchpoint[16];
 
+    /* Fields up to this point are cleared by a CPU reset */
+    struct {} end_reset_fields;
+
     CPU_COMMON
 
     /* These fields after the common ones so they are preserved on reset.  */
@@ -120,6 +120,11 @@ static inline int default_exception_el(DisasContext *s)
 #define DISAS_HVC 8
 #define DISAS_SMC 9
 #define DISAS_YIELD 10
+/* The PC has been written but the instruction may have changed state that
+ * only the main loop looks at (e.g. an exception return unmasking
+ * interrupts), so exit to it rather than chaining with goto_ptr.
+ */
+#define DISAS_EXIT 11
 
 #ifdef TARGET_AARCH64
 void a64_translate_init(void);
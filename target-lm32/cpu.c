@@ -23,6 +23,7 @@
 #include "cpu.h"
 #include "qemu-common.h"
 #include "exec/exec-all.h"
+#include "hw/qdev-properties.h"
 
 
 static void lm32_cpu_set_pc(CPUState *cs, vaddr value)
@@ -128,7 +129,7 @@ static void lm32_cpu_reset(CPUState *s)
     lcc->parent_reset(s);
 
     /* reset cpu state */
-    memset(env, 0, offsetof(CPULM32State, eba));
+    memset(env, 0, offsetof(CPULM32State, end_reset_fields));
 
     lm32_cpu_init_cfg_reg(cpu);
     tlb_flush(s, 1);
@@ -261,6 +262,11 @@ static ObjectClass *lm32_cpu_class_by_name(const char *cpu_model)
     return oc;
 }
 
+static Property lm32_cpu_properties[] = {
+    DEFINE_PROP_BOOL("superblocks", LM32CPU, superblocks, false),
+    DEFINE_PROP_END_OF_LIST()
+};
+
 static void lm32_cpu_class_init(ObjectClass *oc, void *data)
 {
     LM32CPUClass *lcc = LM32_CPU_CLASS(oc);
@@ -269,6 +275,7 @@ static void lm32_cpu_class_init(ObjectClass *oc, void *data)
 
     lcc->parent_realize = dc->realize;
     dc->realize = lm32_cpu_realizefn;
+    dc->props = lm32_cpu_properties;
 
     lcc->parent_reset = cc->reset;
     cc->reset = lm32_cpu_reset;
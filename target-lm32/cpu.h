@@ -31,6 +31,16 @@ struct CPULM32State;
 typedef struct CPULM32State CPULM32State;
 
 #define NB_MMU_MODES 1
+#define TARGET_INSN_START_EXTRA_WORDS 1
+/* There is no MMU, virtual to physical mappings never change, so direct
+ * jumps between TBs may cross page boundaries.  */
+#define TARGET_FIXED_MAPPING 1
+/* The translator embeds no host pointers in the generated code, so it can
+ * be kept across runs (-accel tcg,tb-cache=file).  */
+#define TARGET_SUPPORTS_TB_CACHE
+/* There are no atomics or barriers, and the CSRs backed by devices take the
+ * BQL, so vCPUs may run on their own threads (-accel tcg,thread=multi).  */
+#define TARGET_SUPPORTS_MTTCG
 #define TARGET_PAGE_BITS 12
 static inline int cpu_mmu_index(CPULM32State *env, bool ifetch)
 {
@@ -165,6 +175,9 @@ struct CPULM32State {
     struct CPUBreakpoint *cpu_breakpoint[4];
     struct CPUWatchpoint *cpu_watchpoint[4];
 
+    /* Fields up to this point are cleared by a CPU reset */
+    struct {} end_reset_fields;
+
     CPU_COMMON
 
     /* Fields from here on are preserved across CPU reset. */
@@ -200,6 +213,9 @@ struct LM32CPU {
     uint8_t num_breakpoints;
     uint8_t num_watchpoints;
     uint32_t features;
+
+    /* translate superblocks, see gen_intermediate_code() */
+    bool superblocks;
 };
 
 static inline LM32CPU *lm32_env_get_cpu(CPULM32State *env)
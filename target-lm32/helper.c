@@ -170,6 +170,11 @@ void lm32_cpu_do_interrupt(CPUState *cs)
             /* do_semicall() returns true if call was handled. Otherwise
              * do the normal exception handling. */
             if (lm32_cpu_do_semihosting(cs)) {
+                /* the translator took the scall back from CC, it retires
+                   after all */
+                if (cpu->features & LM32_FEATURE_CYCLE_COUNT) {
+                    env->cc++;
+                }
                 env->pc += 4;
                 break;
             }
@@ -14,7 +14,10 @@
 #include "cpu.h"
 #include "exec/helper-proto.h"
 #include "qemu/log.h"
+#include "qemu/timer.h"
+#include "sysemu/cpus.h"
 #include "exec/softmmu-semi.h"
+#include "exec/cpu-common.h"
 
 enum {
     TARGET_SYS_exit    = 1,
@@ -25,6 +28,16 @@ enum {
     TARGET_SYS_lseek   = 6,
     TARGET_SYS_fstat   = 10,
     TARGET_SYS_stat    = 15,
+
+    /* QEMU extensions */
+    TARGET_SYS_load    = 0x100,
+    TARGET_SYS_clock   = 0x101,
+    TARGET_SYS_perf    = 0x102,
+};
+
+enum {
+    SEMI_CLOCK_VIRTUAL  = 0,    /* QEMU_CLOCK_VIRTUAL, in ns */
+    SEMI_CLOCK_HOST     = 1,    /* host monotonic clock, in ns */
 };
 
 enum {
@@ -110,6 +123,58 @@ static int translate_stat(CPULM32State *env, target_ulong addr,
     return 1;
 }
 
+/*
+ * Move data between a host file and guest memory.  Guest RAM is mapped and
+ * handed to read()/write() directly instead of going through a bounce
+ * buffer filled by the debug accessors.  Returns the number of bytes
+ * transferred, or -1 if nothing could be transferred because of an error.
+ */
+static int semi_transfer(CPUState *cs, int fd, target_ulong addr,
+                         target_ulong len, bool to_guest)
+{
+    target_ulong done = 0;
+
+    while (done < len) {
+        hwaddr phys, plen = len - done;
+        ssize_t n;
+        void *p;
+
+        phys = cpu_get_phys_page_debug(cs, (addr + done) & TARGET_PAGE_MASK);
+        if (phys == -1) {
+            break;
+        }
+        phys += (addr + done) & ~TARGET_PAGE_MASK;
+
+        p = cpu_physical_memory_map(phys, &plen, to_guest);
+        if (!p) {
+            break;
+        }
+        if (to_guest) {
+            n = read(fd, p, plen);
+        } else {
+            n = write(fd, p, plen);
+        }
+        cpu_physical_memory_unmap(p, plen, to_guest, n > 0 ? n : 0);
+
+        if (n < 0) {
+            return done ? done : -1;
+        }
+        done += n;
+        if (n < plen) {
+            break;
+        }
+    }
+
+    return done;
+}
+
+static void semi_set_ret64(CPULM32State *env, uint64_t val)
+{
+    /* returned like a long long: r1 high word, r2 low word */
+    env->regs[R_R1] = val >> 32;
+    env->regs[R_R2] = val;
+}
+
 bool lm32_cpu_do_semihosting(CPUState *cs)
 {
     LM32CPU *cpu = LM32_CPU(cs);
@@ -143,24 +208,12 @@ bool lm32_cpu_do_semihosting(CPUState *cs)
 
     case TARGET_SYS_read:
         /* ssize_t read(int fd, const void *buf, size_t count) */
-        p = lock_user(VERIFY_WRITE, arg1, arg2, 0);
-        if (!p) {
-            ret = -1;
-        } else {
-            ret = read(arg0, p, arg2);
-            unlock_user(p, arg1, arg2);
-        }
+        ret = semi_transfer(cs, arg0, arg1, arg2, true);
         break;
 
     case TARGET_SYS_write:
         /* ssize_t write(int fd, const void *buf, size_t count) */
-        p = lock_user(VERIFY_READ, arg1, arg2, 1);
-        if (!p) {
-            ret = -1;
-        } else {
-            ret = write(arg0, p, arg2);
-            unlock_user(p, arg1, 0);
-        }
+        ret = semi_transfer(cs, arg0, arg1, arg2, false);
         break;
 
     case TARGET_SYS_close:
@@ -202,6 +255,44 @@ bool lm32_cpu_do_semihosting(CPUState *cs)
         }
         break;
 
+    case TARGET_SYS_load:
+        /* ssize_t load(const char *pathname, void *buf, size_t count)
+         * reads up to count bytes of a file straight into guest memory */
+        p = lock_user_string(arg0);
+        if (!p) {
+            ret = -1;
+        } else {
+            int fd = open(p, O_RDONLY);
+
+            unlock_user(p, arg0, 0);
+            if (fd < 0) {
+                ret = -1;
+            } else {
+                ret = semi_transfer(cs, fd, arg1, arg2, true);
+                close(fd);
+            }
+        }
+        break;
+
+    case TARGET_SYS_clock:
+        /* uint64_t clock(int id), in nanoseconds */
+        switch (arg0) {
+        case SEMI_CLOCK_VIRTUAL:
+            semi_set_ret64(env, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+            return true;
+        case SEMI_CLOCK_HOST:
+            semi_set_ret64(env, get_clock());
+            return true;
+        }
+        semi_set_ret64(env, -1);
+        return true;
+
+    case TARGET_SYS_perf:
+        /* uint64_t perf(void), instructions executed so far: the icount
+         * counter with -icount, otherwise the (32-bit) CC register */
+        semi_set_ret64(env, use_icount ? cpu_get_icount_raw() : env->cc);
+        return true;
+
     default:
         /* unhandled */
         return false;
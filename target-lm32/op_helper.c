@@ -11,6 +11,7 @@
 
 #ifndef CONFIG_USER_ONLY
 #include "sysemu/sysemu.h"
+#include "qemu/main-loop.h"
 #endif
 
 #if !defined(CONFIG_USER_ONLY)
@@ -100,44 +101,92 @@ void HELPER(wcsr_dc)(CPULM32State *env, uint32_t dc)
     }
 }
 
+/* The IM/IP and JTX/JRX CSRs are backed by devices (the PIC, which may
+ * raise the interrupt of this or another CPU, and the JTAG UART) and need
+ * the BQL, which multi-threaded TCG vCPUs do not hold.
+ */
+static bool csr_io_lock(void)
+{
+    if (!qemu_mutex_iothread_locked()) {
+        qemu_mutex_lock_iothread();
+        return true;
+    }
+    return false;
+}
+
+static void csr_io_unlock(bool locked)
+{
+    if (locked) {
+        qemu_mutex_unlock_iothread();
+    }
+}
+
 void HELPER(wcsr_im)(CPULM32State *env, uint32_t im)
 {
+    bool locked = csr_io_lock();
+
     lm32_pic_set_im(env->pic_state, im);
+    csr_io_unlock(locked);
 }
 
 void HELPER(wcsr_ip)(CPULM32State *env, uint32_t im)
 {
+    bool locked = csr_io_lock();
+
     lm32_pic_set_ip(env->pic_state, im);
+    csr_io_unlock(locked);
 }
 
 void HELPER(wcsr_jtx)(CPULM32State *env, uint32_t jtx)
 {
+    bool locked = csr_io_lock();
+
     lm32_juart_set_jtx(env->juart_state, jtx);
+    csr_io_unlock(locked);
 }
 
 void HELPER(wcsr_jrx)(CPULM32State *env, uint32_t jrx)
 {
+    bool locked = csr_io_lock();
+
     lm32_juart_set_jrx(env->juart_state, jrx);
+    csr_io_unlock(locked);
 }
 
 uint32_t HELPER(rcsr_im)(CPULM32State *env)
 {
-    return lm32_pic_get_im(env->pic_state);
+    bool locked = csr_io_lock();
+    uint32_t r = lm32_pic_get_im(env->pic_state);
+
+    csr_io_unlock(locked);
+    return r;
 }
 
 uint32_t HELPER(rcsr_ip)(CPULM32State *env)
 {
-    return lm32_pic_get_ip(env->pic_state);
+    bool locked = csr_io_lock();
+    uint32_t r = lm32_pic_get_ip(env->pic_state);
+
+    csr_io_unlock(locked);
+    return r;
 }
 
 uint32_t HELPER(rcsr_jtx)(CPULM32State *env)
 {
-    return lm32_juart_get_jtx(env->juart_state);
+    bool locked = csr_io_lock();
+    uint32_t r = lm32_juart_get_jtx(env->juart_state);
+
+    csr_io_unlock(locked);
+    return r;
 }
 
 uint32_t HELPER(rcsr_jrx)(CPULM32State *env)
 {
-    return lm32_juart_get_jrx(env->juart_state);
+    bool locked = csr_io_lock();
+    uint32_t r = lm32_juart_get_jrx(env->juart_state);
+
+    csr_io_unlock(locked);
+    return r;
 }
 
 /* Try to fill the TLB and return an exception if error. If retaddr is
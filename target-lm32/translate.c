@@ -70,6 +70,17 @@ enum {
     OP_FMT_I
 };
 
+/* Conditional branches a superblock may be extended across.  */
+#define MAX_SIDE_EXITS 8
+/* Out of line divide by zero checks per TB.  */
+#define MAX_DIV_STUBS 16
+
+typedef struct DivStub {
+    TCGLabel *label;
+    target_ulong pc;
+    int retired;        /* insns of the TB retired before the divide */
+} DivStub;
+
 /* This is the state at translation time.  */
 typedef struct DisasContext {
     target_ulong pc;
@@ -93,6 +104,23 @@ typedef struct DisasContext {
     uint32_t features;
     uint8_t num_breakpoints;
     uint8_t num_watchpoints;
+
+    int cc_insn_idx;    /* op index of the per-TB cycle count immediate */
+    bool end_tb;        /* end the TB after this insn */
+    int num_insns;
+
+    /* superblocks */
+    bool superblock;
+    bool follow;            /* continue translating at follow_pc */
+    target_ulong follow_pc;
+    target_ulong pc_end;    /* end of the translated code */
+    unsigned int jmp_slots; /* goto_tb slots in use */
+    int nb_side_exits;
+    int side_exit_idx[MAX_SIDE_EXITS];
+    int side_exit_insns[MAX_SIDE_EXITS];
+
+    int nb_div_stubs;
+    DivStub div_stubs[MAX_DIV_STUBS];
 } DisasContext;
 
 static const char *regnames[] = {
@@ -130,8 +158,30 @@ static inline void t_gen_raise_exception(DisasContext *dc, uint32_t index)
     tcg_temp_free_i32(tmp);
 }
 
+/*
+ * Helpers raising an exception leave the TB with cpu_loop_exit() and do
+ * not go through restore_state_to_opc(), so insns raising one end the TB
+ * and take themselves back from the cycle counter here.
+ */
+static void gen_insn_not_retired(DisasContext *dc)
+{
+    if (dc->features & LM32_FEATURE_CYCLE_COUNT) {
+        tcg_gen_subi_tl(cpu_cc, cpu_cc, 1);
+    }
+    dc->end_tb = true;
+}
+
+/* Raise exception 'index' for the current insn, which does not retire.  */
+static void gen_insn_exception(DisasContext *dc, uint32_t index)
+{
+    gen_insn_not_retired(dc);
+    tcg_gen_movi_tl(cpu_pc, dc->pc);
+    t_gen_raise_exception(dc, index);
+}
+
 static inline void t_gen_illegal_insn(DisasContext *dc)
 {
+    gen_insn_not_retired(dc);
     tcg_gen_movi_tl(cpu_pc, dc->pc);
     gen_helper_ill(cpu_env);
 }
@@ -142,7 +192,7 @@ static inline bool use_goto_tb(DisasContext *dc, target_ulong dest)
         return false;
     }
 
-#ifndef CONFIG_USER_ONLY
+#if !defined(CONFIG_USER_ONLY) && !defined(TARGET_FIXED_MAPPING)
     return (dc->tb->pc & TARGET_PAGE_MASK) == (dest & TARGET_PAGE_MASK);
 #else
     return true;
@@ -151,7 +201,12 @@ static inline bool use_goto_tb(DisasContext *dc, target_ulong dest)
 
 static void gen_goto_tb(DisasContext *dc, int n, target_ulong dest)
 {
-    if (use_goto_tb(dc, dest)) {
+    /* side exits of a superblock may have taken the slot already */
+    if (dc->jmp_slots & (1 << n)) {
+        n ^= 1;
+    }
+    if (use_goto_tb(dc, dest) && !(dc->jmp_slots & (1 << n))) {
+        dc->jmp_slots |= 1 << n;
         tcg_gen_goto_tb(n);
         tcg_gen_movi_tl(cpu_pc, dest);
         tcg_gen_exit_tb((uintptr_t)dc->tb + n);
@@ -160,7 +215,7 @@ static void gen_goto_tb(DisasContext *dc, int n, target_ulong dest)
         if (dc->singlestep_enabled) {
             t_gen_raise_exception(dc, EXCP_DEBUG);
         }
-        tcg_gen_exit_tb(0);
+        tcg_gen_lookup_and_goto_ptr();
     }
 }
 
@@ -203,6 +258,8 @@ static void dec_and(DisasContext *dc)
                 zero_extend(dc->imm16, 16));
     } else  {
         if (dc->r0 == 0 && dc->r1 == 0 && dc->r2 == 0) {
+            /* hlt retires, the CPU resumes after it: only end the TB */
+            dc->end_tb = true;
             tcg_gen_movi_tl(cpu_pc, dc->pc + 4);
             gen_helper_hlt(cpu_env);
         } else {
@@ -252,25 +309,90 @@ static void dec_b(DisasContext *dc)
     }
     tcg_gen_mov_tl(cpu_pc, cpu_R[dc->r0]);
 
-    dc->is_jmp = DISAS_JUMP;
+    /* eret and bret may re-enable interrupts, go back to the main loop */
+    if (dc->r0 == R_EA || dc->r0 == R_BA) {
+        dc->is_jmp = DISAS_UPDATE;
+    } else {
+        dc->is_jmp = DISAS_JUMP;
+    }
+}
+
+/*
+ * A superblock may continue at a forward branch target in the page it
+ * started in, so that [tb->pc, tb->pc + tb->size) still covers all the
+ * code for invalidation.  Backward branches end the TB with a chained
+ * jump: following them would unroll loops (or a "bi ." idle loop) until
+ * max_insns, charging every iteration to one TB execution.
+ */
+static bool sb_can_follow(DisasContext *dc, target_ulong dest)
+{
+    return dc->superblock
+        && dest > dc->pc
+        && (dest & TARGET_PAGE_MASK) == (dc->tb->pc & TARGET_PAGE_MASK);
+}
+
+static void sb_follow(DisasContext *dc, target_ulong dest)
+{
+    dc->follow = true;
+    dc->follow_pc = dest;
+}
+
+/* Leave the superblock early, towards the unlikely side of a branch.  */
+static void sb_gen_side_exit(DisasContext *dc, target_ulong dest)
+{
+    if (dc->features & LM32_FEATURE_CYCLE_COUNT) {
+        /* the rest of the TB was counted on entry, patched at the end */
+        TCGv tmp = tcg_temp_new();
+
+        dc->side_exit_idx[dc->nb_side_exits] = tcg_op_buf_count();
+        dc->side_exit_insns[dc->nb_side_exits] = dc->num_insns;
+        tcg_gen_movi_tl(tmp, 0xdeadbeef);
+        tcg_gen_sub_tl(cpu_cc, cpu_cc, tmp);
+        tcg_temp_free(tmp);
+    }
+    dc->nb_side_exits++;
+
+    gen_goto_tb(dc, 0, dest);
 }
 
 static void dec_bi(DisasContext *dc)
 {
+    target_ulong dest = dc->pc + sign_extend(dc->imm26 << 2, 26);
+
     LOG_DIS("bi %d\n", sign_extend(dc->imm26 << 2, 26));
 
-    gen_goto_tb(dc, 0, dc->pc + (sign_extend(dc->imm26 << 2, 26)));
+    if (sb_can_follow(dc, dest)) {
+        sb_follow(dc, dest);
+        return;
+    }
+
+    gen_goto_tb(dc, 0, dest);
 
     dc->is_jmp = DISAS_TB_JUMP;
 }
 
 static inline void gen_cond_branch(DisasContext *dc, int cond)
 {
+    target_ulong taken = dc->pc + sign_extend(dc->imm16 << 2, 16);
+    target_ulong not_taken = dc->pc + 4;
     TCGLabel *l1 = gen_new_label();
+
+    /* statically predict forward branches not taken and fall through;
+       backward branches close a loop and end the TB */
+    if (taken > dc->pc && dc->nb_side_exits < MAX_SIDE_EXITS
+        && sb_can_follow(dc, not_taken)) {
+        tcg_gen_brcond_tl(tcg_invert_cond(cond),
+                          cpu_R[dc->r0], cpu_R[dc->r1], l1);
+        sb_gen_side_exit(dc, taken);
+        gen_set_label(l1);
+        sb_follow(dc, not_taken);
+        return;
+    }
+
     tcg_gen_brcond_tl(cond, cpu_R[dc->r0], cpu_R[dc->r1], l1);
-    gen_goto_tb(dc, 0, dc->pc + 4);
+    gen_goto_tb(dc, 0, not_taken);
     gen_set_label(l1);
-    gen_goto_tb(dc, 1, dc->pc + (sign_extend(dc->imm16 << 2, 16)));
+    gen_goto_tb(dc, 1, taken);
     dc->is_jmp = DISAS_TB_JUMP;
 }
 
@@ -334,10 +456,16 @@ static void dec_call(DisasContext *dc)
 
 static void dec_calli(DisasContext *dc)
 {
+    target_ulong dest = dc->pc + sign_extend(dc->imm26 << 2, 26);
+
     LOG_DIS("calli %d\n", sign_extend(dc->imm26, 26) * 4);
 
     tcg_gen_movi_tl(cpu_R[R_RA], dc->pc + 4);
-    gen_goto_tb(dc, 0, dc->pc + (sign_extend(dc->imm26 << 2, 26)));
+    if (sb_can_follow(dc, dest)) {
+        sb_follow(dc, dest);
+        return;
+    }
+    gen_goto_tb(dc, 0, dest);
 
     dc->is_jmp = DISAS_TB_JUMP;
 }
@@ -435,10 +563,51 @@ static void dec_cmpne(DisasContext *dc)
     gen_compare(dc, TCG_COND_NE);
 }
 
-static void dec_divu(DisasContext *dc)
+/*
+ * Raise a divide by zero exception if the divisor is zero.  The exception
+ * is raised from a stub placed after the TB's exits, so the divide itself
+ * stays on the fall-through path of a single not-taken branch.
+ */
+static void gen_check_divisor(DisasContext *dc)
 {
+    DivStub *stub;
     TCGLabel *l1;
 
+    if (dc->nb_div_stubs == MAX_DIV_STUBS) {
+        /* out of stubs, check inline and end the TB here, so that only
+           this insn has to be taken back from the cycle counter */
+        l1 = gen_new_label();
+        tcg_gen_brcondi_tl(TCG_COND_NE, cpu_R[dc->r1], 0, l1);
+        gen_insn_exception(dc, EXCP_DIVIDE_BY_ZERO);
+        gen_set_label(l1);
+        return;
+    }
+
+    stub = &dc->div_stubs[dc->nb_div_stubs++];
+    stub->label = gen_new_label();
+    stub->pc = dc->pc;
+    stub->retired = dc->num_insns - 1;
+    tcg_gen_brcondi_tl(TCG_COND_EQ, cpu_R[dc->r1], 0, stub->label);
+}
+
+static void gen_div_stubs(DisasContext *dc)
+{
+    int i;
+
+    for (i = 0; i < dc->nb_div_stubs; i++) {
+        DivStub *stub = &dc->div_stubs[i];
+
+        gen_set_label(stub->label);
+        if (dc->features & LM32_FEATURE_CYCLE_COUNT) {
+            tcg_gen_subi_tl(cpu_cc, cpu_cc, dc->num_insns - stub->retired);
+        }
+        tcg_gen_movi_tl(cpu_pc, stub->pc);
+        t_gen_raise_exception(dc, EXCP_DIVIDE_BY_ZERO);
+    }
+}
+
+static void dec_divu(DisasContext *dc)
+{
     LOG_DIS("divu r%d, r%d, r%d\n", dc->r2, dc->r0, dc->r1);
 
     if (!(dc->features & LM32_FEATURE_DIVIDE)) {
@@ -447,11 +616,7 @@ static void dec_divu(DisasContext *dc)
         return;
     }
 
-    l1 = gen_new_label();
-    tcg_gen_brcondi_tl(TCG_COND_NE, cpu_R[dc->r1], 0, l1);
-    tcg_gen_movi_tl(cpu_pc, dc->pc);
-    t_gen_raise_exception(dc, EXCP_DIVIDE_BY_ZERO);
-    gen_set_label(l1);
+    gen_check_divisor(dc);
     tcg_gen_divu_tl(cpu_R[dc->r2], cpu_R[dc->r0], cpu_R[dc->r1]);
 }
 
@@ -517,8 +682,6 @@ static void dec_lw(DisasContext *dc)
 
 static void dec_modu(DisasContext *dc)
 {
-    TCGLabel *l1;
-
     LOG_DIS("modu r%d, r%d, %d\n", dc->r2, dc->r0, dc->r1);
 
     if (!(dc->features & LM32_FEATURE_DIVIDE)) {
@@ -527,11 +690,7 @@ static void dec_modu(DisasContext *dc)
         return;
     }
 
-    l1 = gen_new_label();
-    tcg_gen_brcondi_tl(TCG_COND_NE, cpu_R[dc->r1], 0, l1);
-    tcg_gen_movi_tl(cpu_pc, dc->pc);
-    t_gen_raise_exception(dc, EXCP_DIVIDE_BY_ZERO);
-    gen_set_label(l1);
+    gen_check_divisor(dc);
     tcg_gen_remu_tl(cpu_R[dc->r2], cpu_R[dc->r0], cpu_R[dc->r1]);
 }
 
@@ -615,13 +774,11 @@ static void dec_scall(DisasContext *dc)
     switch (dc->imm5) {
     case 2:
         LOG_DIS("break\n");
-        tcg_gen_movi_tl(cpu_pc, dc->pc);
-        t_gen_raise_exception(dc, EXCP_BREAKPOINT);
+        gen_insn_exception(dc, EXCP_BREAKPOINT);
         break;
     case 7:
         LOG_DIS("scall\n");
-        tcg_gen_movi_tl(cpu_pc, dc->pc);
-        t_gen_raise_exception(dc, EXCP_SYSTEMCALL);
+        gen_insn_exception(dc, EXCP_SYSTEMCALL);
         break;
     default:
         qemu_log_mask(LOG_GUEST_ERROR, "invalid opcode @0x%x", dc->pc);
@@ -645,7 +802,14 @@ static void dec_rcsr(DisasContext *dc)
         gen_helper_rcsr_ip(cpu_R[dc->r2], cpu_env);
         break;
     case CSR_CC:
-        tcg_gen_mov_tl(cpu_R[dc->r2], cpu_cc);
+        if (dc->features & LM32_FEATURE_CYCLE_COUNT) {
+            /* cc was advanced by the whole TB on entry, and the TB ends
+             * with this insn, so it has already counted itself.  */
+            tcg_gen_subi_tl(cpu_R[dc->r2], cpu_cc, 1);
+            dc->end_tb = true;
+        } else {
+            tcg_gen_mov_tl(cpu_R[dc->r2], cpu_cc);
+        }
         break;
     case CSR_CFG:
         tcg_gen_mov_tl(cpu_R[dc->r2], cpu_cfg);
@@ -777,17 +941,21 @@ static void dec_sr(DisasContext *dc)
             return;
         }
         tcg_gen_sari_tl(cpu_R[dc->r1], cpu_R[dc->r0], dc->imm5);
+    } else if (dc->features & LM32_FEATURE_SHIFT) {
+        /* keep the common case free of labels and local temps */
+        TCGv t0 = tcg_temp_new();
+        tcg_gen_andi_tl(t0, cpu_R[dc->r1], 0x1f);
+        tcg_gen_sar_tl(cpu_R[dc->r2], cpu_R[dc->r0], t0);
+        tcg_temp_free(t0);
     } else {
         TCGLabel *l1 = gen_new_label();
         TCGLabel *l2 = gen_new_label();
         TCGv t0 = tcg_temp_local_new();
         tcg_gen_andi_tl(t0, cpu_R[dc->r1], 0x1f);
 
-        if (!(dc->features & LM32_FEATURE_SHIFT)) {
-            tcg_gen_brcondi_tl(TCG_COND_EQ, t0, 1, l1);
-            t_gen_illegal_insn(dc);
-            tcg_gen_br(l2);
-        }
+        tcg_gen_brcondi_tl(TCG_COND_EQ, t0, 1, l1);
+        t_gen_illegal_insn(dc);
+        tcg_gen_br(l2);
 
         gen_set_label(l1);
         tcg_gen_sar_tl(cpu_R[dc->r2], cpu_R[dc->r0], t0);
@@ -813,17 +981,21 @@ static void dec_sru(DisasContext *dc)
             return;
         }
         tcg_gen_shri_tl(cpu_R[dc->r1], cpu_R[dc->r0], dc->imm5);
+    } else if (dc->features & LM32_FEATURE_SHIFT) {
+        /* keep the common case free of labels and local temps */
+        TCGv t0 = tcg_temp_new();
+        tcg_gen_andi_tl(t0, cpu_R[dc->r1], 0x1f);
+        tcg_gen_shr_tl(cpu_R[dc->r2], cpu_R[dc->r0], t0);
+        tcg_temp_free(t0);
     } else {
         TCGLabel *l1 = gen_new_label();
         TCGLabel *l2 = gen_new_label();
         TCGv t0 = tcg_temp_local_new();
         tcg_gen_andi_tl(t0, cpu_R[dc->r1], 0x1f);
 
-        if (!(dc->features & LM32_FEATURE_SHIFT)) {
-            tcg_gen_brcondi_tl(TCG_COND_EQ, t0, 1, l1);
-            t_gen_illegal_insn(dc);
-            tcg_gen_br(l2);
-        }
+        tcg_gen_brcondi_tl(TCG_COND_EQ, t0, 1, l1);
+        t_gen_illegal_insn(dc);
+        tcg_gen_br(l2);
 
         gen_set_label(l1);
         tcg_gen_shr_tl(cpu_R[dc->r2], cpu_R[dc->r0], t0);
@@ -1053,6 +1225,7 @@ void gen_intermediate_code(CPULM32State *env, struct TranslationBlock *tb)
     uint32_t next_page_start;
     int num_insns;
     int max_insns;
+    int i;
 
     pc_start = tb->pc;
     dc->features = cpu->features;
@@ -1063,6 +1236,15 @@ void gen_intermediate_code(CPULM32State *env, struct TranslationBlock *tb)
     dc->is_jmp = DISAS_NEXT;
     dc->pc = pc_start;
     dc->singlestep_enabled = cs->singlestep_enabled;
+    dc->end_tb = false;
+    dc->jmp_slots = 0;
+    dc->nb_div_stubs = 0;
+
+    /* Side exits would leave the icount budget of the whole TB spent.  */
+    dc->superblock = cpu->superblocks && !singlestep
+        && !cs->singlestep_enabled && !(tb->cflags & CF_USE_ICOUNT);
+    dc->follow = false;
+    dc->nb_side_exits = 0;
 
     if (pc_start & 3) {
         qemu_log_mask(LOG_GUEST_ERROR,
@@ -1071,6 +1253,7 @@ void gen_intermediate_code(CPULM32State *env, struct TranslationBlock *tb)
     }
 
     next_page_start = (pc_start & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
+    dc->pc_end = pc_start;
     num_insns = 0;
     max_insns = tb->cflags & CF_COUNT_MASK;
     if (max_insns == 0) {
@@ -1081,13 +1264,27 @@ void gen_intermediate_code(CPULM32State *env, struct TranslationBlock *tb)
     }
 
     gen_tb_start(tb);
+
+    /* The cycle counter counts retired insns.  Rather than counting each
+       one, advance it by the insn count of the TB on entry; the count is
+       patched in below once it is known, and restore_state_to_opc() takes
+       back the insns that did not retire when the TB is left early.  */
+    if (dc->features & LM32_FEATURE_CYCLE_COUNT) {
+        TCGv tmp = tcg_temp_new();
+
+        dc->cc_insn_idx = tcg_op_buf_count();
+        tcg_gen_movi_tl(tmp, 0xdeadbeef);
+        tcg_gen_add_tl(cpu_cc, cpu_cc, tmp);
+        tcg_temp_free(tmp);
+    }
+
     do {
-        tcg_gen_insn_start(dc->pc);
+        tcg_gen_insn_start(dc->pc, num_insns);
         num_insns++;
+        dc->num_insns = num_insns;
 
         if (unlikely(cpu_breakpoint_test(cs, dc->pc, BP_ANY))) {
-            tcg_gen_movi_tl(cpu_pc, dc->pc);
-            t_gen_raise_exception(dc, EXCP_DEBUG);
+            gen_insn_exception(dc, EXCP_DEBUG);
             dc->is_jmp = DISAS_UPDATE;
             /* The address covered by the breakpoint must be included in
                [tb->pc, tb->pc + tb->size) in order to for it to be
@@ -1105,8 +1302,15 @@ void gen_intermediate_code(CPULM32State *env, struct TranslationBlock *tb)
         }
 
         decode(dc, cpu_ldl_code(env, dc->pc));
-        dc->pc += 4;
+        dc->pc_end = MAX(dc->pc_end, dc->pc + 4);
+        if (dc->follow) {
+            dc->follow = false;
+            dc->pc = dc->follow_pc;
+        } else {
+            dc->pc += 4;
+        }
     } while (!dc->is_jmp
+         && !dc->end_tb
          && !tcg_op_buf_full()
          && !cs->singlestep_enabled
          && !singlestep
@@ -1127,8 +1331,11 @@ void gen_intermediate_code(CPULM32State *env, struct TranslationBlock *tb)
         case DISAS_NEXT:
             gen_goto_tb(dc, 1, dc->pc);
             break;
-        default:
         case DISAS_JUMP:
+            /* look up the next TB without leaving generated code */
+            tcg_gen_lookup_and_goto_ptr();
+            break;
+        default:
         case DISAS_UPDATE:
             /* indicate that the hash table must be used
                to find the next TB */
@@ -1140,9 +1347,18 @@ void gen_intermediate_code(CPULM32State *env, struct TranslationBlock *tb)
         }
     }
 
+    gen_div_stubs(dc);
+
+    if (dc->features & LM32_FEATURE_CYCLE_COUNT) {
+        tcg_set_insn_param(dc->cc_insn_idx, 1, num_insns);
+        for (i = 0; i < dc->nb_side_exits; i++) {
+            tcg_set_insn_param(dc->side_exit_idx[i], 1,
+                               num_insns - dc->side_exit_insns[i]);
+        }
+    }
     gen_tb_end(tb, num_insns);
 
-    tb->size = dc->pc - pc_start;
+    tb->size = MAX(dc->pc, dc->pc_end) - pc_start;
     tb->icount = num_insns;
 
 #ifdef DEBUG_DISAS
@@ -1150,9 +1366,9 @@ void gen_intermediate_code(CPULM32State *env, struct TranslationBlock *tb)
         && qemu_log_in_addr_range(pc_start)) {
         qemu_log_lock();
         qemu_log("\n");
-        log_target_disas(cs, pc_start, dc->pc - pc_start, 0);
+        log_target_disas(cs, pc_start, tb->size, 0);
         qemu_log("\nisize=%d osize=%d\n",
-                 dc->pc - pc_start, tcg_op_buf_count());
+                 tb->size, tcg_op_buf_count());
         qemu_log_unlock();
     }
 #endif
@@ -1196,6 +1412,10 @@ void restore_state_to_opc(CPULM32State *env, TranslationBlock *tb,
                           target_ulong *data)
 {
     env->pc = data[0];
+    /* data[1] insns retired before this one, the TB counted all of them */
+    if (lm32_env_get_cpu(env)->features & LM32_FEATURE_CYCLE_COUNT) {
+        env->cc -= tb->icount - data[1];
+    }
 }
 
 void lm32_translate_init(void)
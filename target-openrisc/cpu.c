@@ -45,7 +45,7 @@ static void openrisc_cpu_reset(CPUState *s)
     occ->parent_reset(s);
 
 #ifndef CONFIG_USER_ONLY
-    memset(&cpu->env, 0, offsetof(CPUOpenRISCState, tlb));
+    memset(&cpu->env, 0, offsetof(CPUOpenRISCState, end_reset_fields));
 #else
     memset(&cpu->env, 0, offsetof(CPUOpenRISCState, irq));
 #endif
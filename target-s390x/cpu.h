@@ -139,9 +139,12 @@ typedef struct CPUS390XState {
 
     uint8_t riccb[64];
 
+    /* Fields up to this point are cleared by a CPU reset */
+    struct {} end_reset_fields;
+
     CPU_COMMON
 
-    /* reset does memset(0) up to here */
+    /* Fields from here on are preserved across CPU reset. */
 
     uint32_t cpu_num;
     uint32_t machine_type;
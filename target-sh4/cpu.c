@@ -56,7 +56,7 @@ static void superh_cpu_reset(CPUState *s)
 
     scc->parent_reset(s);
 
-    memset(env, 0, offsetof(CPUSH4State, id));
+    memset(env, 0, offsetof(CPUSH4State, end_reset_fields));
     tlb_flush(s, 1);
 
     env->pc = 0xA0000000;
@@ -0,0 +1,545 @@
+/*
+ * Persistent translation block cache
+ *
+ * With -accel tcg,tb-cache=FILE the host code of every TB generated is
+ * also kept in memory together with the guest code it was translated
+ * from, and written to FILE when QEMU exits.  The next run loads FILE and,
+ * when tb_gen_code() is asked for a TB with the same physical address,
+ * pc, cs_base, flags and cflags, and the guest bytes in
+ * [pc, pc + tb->size) are still the same, copies the code into the code
+ * buffer instead of translating it again.  The TB is then linked like any
+ * other one, so self-modifying code invalidates it through the usual
+ * tb_invalidate_phys_page_range() machinery.
+ *
+ * Generated code refers to helpers, to the prologue and to its own
+ * TranslationBlock.  Backends that define TCG_TARGET_TB_CACHE record those
+ * references with tcg_cache_reloc() while the cache is enabled, and they
+ * are patched when the code is loaded.  Frontends must not embed host
+ * pointers in the code and say so with TARGET_SUPPORTS_TB_CACHE.
+ *
+ * The file is only reused by the same QEMU binary, for the same CPU model
+ * and properties, on a host with the same relevant CPU features.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "qapi/error.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/log.h"
+#include "qemu/rcu.h"
+#include "qom/cpu.h"
+#include "exec/exec-all.h"
+#include "exec/memory.h"
+#include "exec/tb-cache.h"
+#include "exec/tb-hash.h"
+#include "sysemu/sysemu.h"
+#include "tcg.h"
+
+#define TB_CACHE_MAGIC "QEMUTBC1"
+
+typedef struct QEMU_PACKED TBCacheRecord {
+    uint64_t phys_pc;
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint16_t guest_size;
+    uint16_t icount;
+    uint16_t jmp_reset_offset[2];
+    uint16_t jmp_insn_offset[2];
+    uint32_t code_size;
+    uint32_t search_size;
+    uint32_t nb_relocs;
+} TBCacheRecord;
+
+/* The key is the first 32 bytes of the record.  */
+#define TB_CACHE_KEY_SIZE offsetof(TBCacheRecord, guest_size)
+
+typedef struct TBCacheEntry {
+    TBCacheRecord rec;
+    /* guest code, host code, search data, then relocations */
+    uint8_t *data;
+} TBCacheEntry;
+
+static struct {
+    char *path;
+    bool opened;
+    char *config;
+    QemuMutex lock;
+    GHashTable *entries;
+    bool dirty;
+    Notifier exit;
+
+    unsigned hits;
+    unsigned misses;
+    unsigned stale;
+    unsigned records;
+} tb_cache;
+
+static size_t tb_cache_data_size(const TBCacheRecord *rec)
+{
+    return rec->guest_size + rec->code_size + rec->search_size +
+           rec->nb_relocs * sizeof(TCGCacheReloc);
+}
+
+static guint tb_cache_hash(gconstpointer p)
+{
+    const TBCacheRecord *rec = p;
+
+    return tb_hash_func(rec->phys_pc, rec->pc, rec->flags);
+}
+
+static gboolean tb_cache_equal(gconstpointer a, gconstpointer b)
+{
+    return memcmp(a, b, TB_CACHE_KEY_SIZE) == 0;
+}
+
+static void tb_cache_entry_free(gpointer p)
+{
+    TBCacheEntry *e = p;
+
+    g_free(e->data);
+    g_free(e);
+}
+
+static void tb_cache_insert(TBCacheEntry *e)
+{
+    g_hash_table_replace(tb_cache.entries, &e->rec, e);
+}
+
+static int tb_cache_prop_compare(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * Describe everything the generated code depends on besides the TB key:
+ * the QEMU binary, the host and the CPU model.  NULL if the binary cannot
+ * be identified.
+ */
+static char *tb_cache_config(CPUState *cpu)
+{
+    Object *obj = OBJECT(cpu);
+    ObjectPropertyIterator iter;
+    ObjectProperty *prop;
+    GPtrArray *props;
+    GString *s;
+    struct stat st;
+    guint i;
+
+    if (stat("/proc/self/exe", &st) < 0) {
+        return NULL;
+    }
+
+    s = g_string_new(NULL);
+    g_string_append_printf(s, "qemu %s %s exe %ju:%ju:%jd:%jd.%09ld\n",
+                           QEMU_VERSION, TARGET_NAME,
+                           (uintmax_t)st.st_dev, (uintmax_t)st.st_ino,
+                           (intmax_t)st.st_size, (intmax_t)st.st_mtime,
+                           (long)st.st_mtim.tv_nsec);
+    g_string_append_printf(s, "host %08x parallel %d\n",
+                           tcg_cache_host_signature(), parallel_cpus);
+    g_string_append_printf(s, "cpu %s", object_get_typename(obj));
+
+    /* property order must not depend on the hash table */
+    props = g_ptr_array_new_with_free_func(g_free);
+    object_property_iter_init(&iter, obj);
+    while ((prop = object_property_iter_next(&iter))) {
+        char *value;
+
+        if (!prop->get || strstart(prop->type, "child<", NULL) ||
+            strstart(prop->type, "link<", NULL)) {
+            continue;
+        }
+        value = object_property_print(obj, prop->name, false, NULL);
+        if (value) {
+            g_ptr_array_add(props, g_strdup_printf("%s=%s", prop->name,
+                                                   value));
+            g_free(value);
+        }
+    }
+    g_ptr_array_sort(props, tb_cache_prop_compare);
+    for (i = 0; i < props->len; i++) {
+        g_string_append_printf(s, " %s", (char *)g_ptr_array_index(props, i));
+    }
+    g_ptr_array_free(props, true);
+
+    return g_string_free(s, false);
+}
+
+static bool tb_cache_check_record(const TBCacheRecord *rec,
+                                  const uint8_t *data)
+{
+    const uint8_t *relocs = data + rec->guest_size + rec->code_size +
+                            rec->search_size;
+    uint32_t i, j;
+
+    if (rec->guest_size == 0 || rec->guest_size > TARGET_PAGE_SIZE ||
+        rec->code_size == 0 || rec->code_size > UINT16_MAX ||
+        rec->nb_relocs > TCG_MAX_CACHE_RELOCS) {
+        return false;
+    }
+    for (j = 0; j < 2; j++) {
+        if (rec->jmp_reset_offset[j] != TB_JMP_RESET_OFFSET_INVALID &&
+            (rec->jmp_reset_offset[j] > rec->code_size ||
+             rec->jmp_insn_offset[j] + 4 > rec->code_size)) {
+            return false;
+        }
+    }
+    for (i = 0; i < rec->nb_relocs; i++) {
+        TCGCacheReloc r;
+
+        memcpy(&r, relocs + i * sizeof(r), sizeof(r));
+        if (r.base > TCG_CACHE_BASE_TB ||
+            (r.type == TCG_CACHE_RELOC_PC32 &&
+             r.offset + 4 > rec->code_size) ||
+            (r.type == TCG_CACHE_RELOC_ABS64 &&
+             r.offset + 8 > rec->code_size) ||
+            r.type > TCG_CACHE_RELOC_ABS64) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void tb_cache_parse(const uint8_t *buf, size_t len)
+{
+    const uint8_t *end = buf + len;
+    size_t magic_len = strlen(TB_CACHE_MAGIC);
+    size_t config_len = strlen(tb_cache.config);
+    uint32_t header_len;
+
+    if (len < magic_len + 4 || memcmp(buf, TB_CACHE_MAGIC, magic_len)) {
+        error_report("tb-cache: %s is not a TB cache file, ignoring it",
+                     tb_cache.path);
+        return;
+    }
+    buf += magic_len;
+    memcpy(&header_len, buf, 4);
+    buf += 4;
+    if (header_len != config_len || end - buf < header_len ||
+        memcmp(buf, tb_cache.config, config_len)) {
+        /* another binary or machine: start over */
+        return;
+    }
+    buf += header_len;
+
+    while (buf < end) {
+        TBCacheEntry *e;
+        size_t size;
+
+        if (end - buf < sizeof(TBCacheRecord)) {
+            goto truncated;
+        }
+        e = g_new(TBCacheEntry, 1);
+        memcpy(&e->rec, buf, sizeof(TBCacheRecord));
+        buf += sizeof(TBCacheRecord);
+        size = tb_cache_data_size(&e->rec);
+        if (end - buf < size || !tb_cache_check_record(&e->rec, buf)) {
+            g_free(e);
+            goto truncated;
+        }
+        e->data = g_memdup(buf, size);
+        buf += size;
+        tb_cache_insert(e);
+    }
+    return;
+
+truncated:
+    error_report("tb-cache: %s is corrupted, ignoring the rest of it",
+                 tb_cache.path);
+}
+
+static bool tb_cache_open(CPUState *cpu)
+{
+    gchar *buf;
+    gsize len;
+
+    tb_cache.opened = true;
+    tb_cache.config = tb_cache_config(cpu);
+    if (!tb_cache.config) {
+        error_report("tb-cache: cannot identify the QEMU binary, "
+                     "the TB cache is disabled");
+        g_free(tb_cache.path);
+        tb_cache.path = NULL;
+        return false;
+    }
+
+    if (g_file_get_contents(tb_cache.path, &buf, &len, NULL)) {
+        tb_cache_parse((const uint8_t *)buf, len);
+        g_free(buf);
+    }
+    return true;
+}
+
+static void tb_cache_save(Notifier *notifier, void *data)
+{
+    GHashTableIter iter;
+    TBCacheEntry *e;
+    uint32_t header_len;
+    bool failed;
+    char *tmp;
+    FILE *f;
+
+    qemu_mutex_lock(&tb_cache.lock);
+    if (!tb_cache.path || !tb_cache.dirty) {
+        goto out;
+    }
+
+    /* another QEMU may be using the file: replace it atomically */
+    tmp = g_strdup_printf("%s.%d.tmp", tb_cache.path, (int)getpid());
+    f = fopen(tmp, "wb");
+    if (!f) {
+        error_report("tb-cache: cannot create %s: %s", tmp, strerror(errno));
+        g_free(tmp);
+        goto out;
+    }
+
+    header_len = strlen(tb_cache.config);
+    fwrite(TB_CACHE_MAGIC, strlen(TB_CACHE_MAGIC), 1, f);
+    fwrite(&header_len, sizeof(header_len), 1, f);
+    fwrite(tb_cache.config, header_len, 1, f);
+    g_hash_table_iter_init(&iter, tb_cache.entries);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&e)) {
+        fwrite(&e->rec, sizeof(e->rec), 1, f);
+        fwrite(e->data, tb_cache_data_size(&e->rec), 1, f);
+    }
+
+    failed = ferror(f);
+    failed |= fclose(f) != 0;
+    if (failed) {
+        error_report("tb-cache: cannot write %s", tmp);
+        unlink(tmp);
+    } else if (rename(tmp, tb_cache.path) < 0) {
+        error_report("tb-cache: cannot rename %s to %s: %s",
+                     tmp, tb_cache.path, strerror(errno));
+        unlink(tmp);
+    } else {
+        tb_cache.dirty = false;
+    }
+    g_free(tmp);
+
+out:
+    qemu_mutex_unlock(&tb_cache.lock);
+}
+
+void tb_cache_init(const char *path, Error **errp)
+{
+#if !TCG_TARGET_TB_CACHE
+    error_setg(errp, "The TB cache is not supported on this host");
+#elif !defined(TARGET_SUPPORTS_TB_CACHE)
+    error_setg(errp, "This guest does not support the TB cache");
+#else
+    tb_cache.path = g_strdup(path);
+    qemu_mutex_init(&tb_cache.lock);
+    tb_cache.entries = g_hash_table_new_full(tb_cache_hash, tb_cache_equal,
+                                             NULL, tb_cache_entry_free);
+    tb_cache.exit.notify = tb_cache_save;
+    qemu_add_exit_notifier(&tb_cache.exit);
+#endif
+}
+
+/* Called with tb_lock held.  */
+bool tb_cache_enabled(CPUState *cpu, uint32_t cflags)
+{
+    if (!tb_cache.path) {
+        return false;
+    }
+    /* only TBs that tb_find() would ask for, translated normally */
+    if (cflags & (CF_COUNT_MASK | CF_LAST_IO | CF_NOCACHE |
+                  CF_IGNORE_ICOUNT)) {
+        return false;
+    }
+    if (singlestep || cpu->singlestep_enabled ||
+        !QTAILQ_EMPTY(&cpu->breakpoints) ||
+        qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN)) {
+        return false;
+    }
+    return tb_cache.opened || tb_cache_open(cpu);
+}
+
+static bool tb_cache_relocate(TranslationBlock *tb, const TBCacheEntry *e,
+                              uint8_t *code)
+{
+    const uint8_t *relocs = e->data + e->rec.guest_size +
+                            e->rec.code_size + e->rec.search_size;
+    uint32_t i;
+
+    for (i = 0; i < e->rec.nb_relocs; i++) {
+        uint8_t *where;
+        uintptr_t target;
+        TCGCacheReloc r;
+
+        memcpy(&r, relocs + i * sizeof(r), sizeof(r));
+        where = code + r.offset;
+        switch (r.base) {
+        case TCG_CACHE_BASE_TEXT:
+            target = (uintptr_t)tcg_gen_code + r.addend;
+            break;
+        case TCG_CACHE_BASE_PROLOGUE:
+            target = (uintptr_t)tcg_ctx.code_gen_prologue + r.addend;
+            break;
+        default:
+            target = (uintptr_t)tb + r.addend;
+            break;
+        }
+
+        if (r.type == TCG_CACHE_RELOC_PC32) {
+            intptr_t disp = target - (uintptr_t)(where + 4);
+            int32_t disp32 = disp;
+
+            if (disp != disp32) {
+                return false;
+            }
+            memcpy(where, &disp32, 4);
+        } else {
+            uint64_t abs64 = target;
+
+            memcpy(where, &abs64, 8);
+        }
+    }
+    return true;
+}
+
+/*
+ * Fill in TB from the cache, at tcg_ctx.code_gen_ptr.  Returns false if
+ * it has to be translated.  Called with tb_lock held.
+ */
+bool tb_cache_load(CPUState *cpu, TranslationBlock *tb,
+                   tb_page_addr_t phys_pc, int *code_size, int *search_size)
+{
+    uint8_t *code = tcg_ctx.code_gen_ptr;
+    TBCacheRecord key;
+    TBCacheEntry *e;
+    bool ok = false;
+
+    if (!tb_cache_enabled(cpu, tb->cflags)) {
+        return false;
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.phys_pc = phys_pc;
+    key.pc = tb->pc;
+    key.cs_base = tb->cs_base;
+    key.flags = tb->flags;
+    key.cflags = tb->cflags;
+
+    qemu_mutex_lock(&tb_cache.lock);
+    e = g_hash_table_lookup(tb_cache.entries, &key);
+    if (!e) {
+        tb_cache.misses++;
+        goto out;
+    }
+
+    rcu_read_lock();
+    ok = memcmp(qemu_map_ram_ptr(NULL, phys_pc), e->data,
+                e->rec.guest_size) == 0;
+    rcu_read_unlock();
+    if (!ok) {
+        tb_cache.stale++;
+        goto out;
+    }
+
+    ok = false;
+    if (code + e->rec.code_size + e->rec.search_size >
+        (uint8_t *)tcg_ctx.code_gen_highwater) {
+        /* let translation flush the buffer */
+        goto out;
+    }
+    memcpy(code, e->data + e->rec.guest_size,
+           e->rec.code_size + e->rec.search_size);
+    if (!tb_cache_relocate(tb, e, code)) {
+        tb_cache.stale++;
+        goto out;
+    }
+
+    tb->size = e->rec.guest_size;
+    tb->icount = e->rec.icount;
+    tb->tc_search = code + e->rec.code_size;
+    tb->jmp_reset_offset[0] = e->rec.jmp_reset_offset[0];
+    tb->jmp_reset_offset[1] = e->rec.jmp_reset_offset[1];
+#ifdef USE_DIRECT_JUMP
+    tb->jmp_insn_offset[0] = e->rec.jmp_insn_offset[0];
+    tb->jmp_insn_offset[1] = e->rec.jmp_insn_offset[1];
+#endif
+    flush_icache_range((uintptr_t)code, (uintptr_t)code + e->rec.code_size);
+
+    *code_size = e->rec.code_size;
+    *search_size = e->rec.search_size;
+    tb_cache.hits++;
+    ok = true;
+
+out:
+    qemu_mutex_unlock(&tb_cache.lock);
+    return ok;
+}
+
+/*
+ * Remember TB, which was just generated with tcg_ctx.cache_tb set, before
+ * it is linked.  Called with tb_lock held.
+ */
+void tb_cache_record(TranslationBlock *tb, tb_page_addr_t phys_pc,
+                     int code_size, int search_size)
+{
+    size_t relocs_size;
+    TBCacheEntry *e;
+    uint8_t *p;
+
+    /* the guest code must be found at phys_pc only */
+    if (tcg_ctx.nb_cache_relocs < 0 || code_size > UINT16_MAX ||
+        ((tb->pc ^ (tb->pc + tb->size - 1)) & TARGET_PAGE_MASK)) {
+        return;
+    }
+
+    e = g_new0(TBCacheEntry, 1);
+    e->rec.phys_pc = phys_pc;
+    e->rec.pc = tb->pc;
+    e->rec.cs_base = tb->cs_base;
+    e->rec.flags = tb->flags;
+    e->rec.cflags = tb->cflags;
+    e->rec.guest_size = tb->size;
+    e->rec.icount = tb->icount;
+    e->rec.jmp_reset_offset[0] = tb->jmp_reset_offset[0];
+    e->rec.jmp_reset_offset[1] = tb->jmp_reset_offset[1];
+#ifdef USE_DIRECT_JUMP
+    e->rec.jmp_insn_offset[0] = tb->jmp_insn_offset[0];
+    e->rec.jmp_insn_offset[1] = tb->jmp_insn_offset[1];
+#endif
+    e->rec.code_size = code_size;
+    e->rec.search_size = search_size;
+    e->rec.nb_relocs = tcg_ctx.nb_cache_relocs;
+
+    relocs_size = e->rec.nb_relocs * sizeof(TCGCacheReloc);
+    e->data = p = g_malloc(tb_cache_data_size(&e->rec));
+    rcu_read_lock();
+    memcpy(p, qemu_map_ram_ptr(NULL, phys_pc), tb->size);
+    rcu_read_unlock();
+    p += tb->size;
+    memcpy(p, tb->tc_ptr, code_size + search_size);
+    p += code_size + search_size;
+    memcpy(p, tcg_ctx.cache_relocs, relocs_size);
+
+    qemu_mutex_lock(&tb_cache.lock);
+    tb_cache_insert(e);
+    tb_cache.records++;
+    tb_cache.dirty = true;
+    qemu_mutex_unlock(&tb_cache.lock);
+}
+
+void tb_cache_dump_info(FILE *f, fprintf_function cpu_fprintf)
+{
+    if (!tb_cache.path) {
+        return;
+    }
+    qemu_mutex_lock(&tb_cache.lock);
+    cpu_fprintf(f, "TB cache entries    %u\n",
+                tb_cache.entries ? g_hash_table_size(tb_cache.entries) : 0);
+    cpu_fprintf(f, "TB cache hits       %u (%u misses, %u stale)\n",
+                tb_cache.hits, tb_cache.misses, tb_cache.stale);
+    cpu_fprintf(f, "TB cache records    %u\n", tb_cache.records);
+    qemu_mutex_unlock(&tb_cache.lock);
+}
@@ -772,6 +772,19 @@ static inline void tcg_gen_exit_tb(uintptr_t val)
  */
 void tcg_gen_goto_tb(unsigned idx);
 
+/**
+ * tcg_gen_lookup_and_goto_ptr() - look up the next TB and jump to it
+ *
+ * Look up the TB for the current CPU state (which the frontend must have
+ * fully written back, as for exit_tb) and branch to it directly, falling
+ * back to the epilogue if none is found.  Use this instead of exit_tb(0)
+ * for indirect branches; instructions that may unmask interrupts or
+ * otherwise need the main loop to run should keep using exit_tb(0).
+ *
+ * See tcg/README for more info about the underlying goto_ptr operation.
+ */
+void tcg_gen_lookup_and_goto_ptr(void);
+
 #if TARGET_LONG_BITS == 32
 #define tcg_temp_new() tcg_temp_new_i32()
 #define tcg_global_reg_new tcg_global_reg_new_i32
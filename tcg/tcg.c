@@ -250,8 +250,61 @@ TCGLabel *gen_new_label(void)
     return l;
 }
 
+/* persistent TB cache relocations */
+
+static inline bool tcg_cache_recording(TCGContext *s)
+{
+    return TCG_TARGET_TB_CACHE && s->cache_tb != NULL;
+}
+
+/* Record that the field at WHERE refers to TARGET, which lies outside of
+   the TB being generated, so that the field can be rewritten when the TB
+   is loaded from the cache at another address.  */
+static void __attribute__((unused))
+tcg_cache_reloc(TCGContext *s, tcg_insn_unit *where,
+                TCGCacheRelocType type, uintptr_t target)
+{
+    uintptr_t prologue = (uintptr_t)s->code_gen_prologue;
+    uintptr_t tb = (uintptr_t)s->cache_tb;
+    TCGCacheReloc *r;
+
+    if (!tcg_cache_recording(s) || s->nb_cache_relocs < 0) {
+        return;
+    }
+    if (s->nb_cache_relocs == TCG_MAX_CACHE_RELOCS) {
+        s->nb_cache_relocs = -1;
+        return;
+    }
+
+    r = &s->cache_relocs[s->nb_cache_relocs++];
+    r->offset = tcg_ptr_byte_diff(where, s->code_buf);
+    r->type = type;
+    r->pad = 0;
+    if (target - tb < sizeof(TranslationBlock)) {
+        r->base = TCG_CACHE_BASE_TB;
+        r->addend = target - tb;
+    } else if (target - prologue < (uintptr_t)s->code_gen_buffer - prologue) {
+        r->base = TCG_CACHE_BASE_PROLOGUE;
+        r->addend = target - prologue;
+    } else {
+        r->base = TCG_CACHE_BASE_TEXT;
+        r->addend = target - (uintptr_t)tcg_gen_code;
+    }
+}
+
 #include "tcg-target.inc.c"
 
+/* Describe the host features the generated code may depend on, so that the
+   persistent TB cache is not reused on a different host CPU.  */
+uint32_t tcg_cache_host_signature(void)
+{
+#if TCG_TARGET_TB_CACHE
+    return tcg_target_cache_signature();
+#else
+    return 0;
+#endif
+}
+
 /* pool based memory allocation */
 void *tcg_malloc_internal(TCGContext *s, int size)
 {
@@ -390,6 +443,10 @@ void tcg_prologue_init(TCGContext *s)
     s->code_buf = buf0;
     s->code_gen_prologue = buf0;
 
+    /* The backend sets the epilogue if it implements goto_ptr: that is
+       where a failed lookup_tb_ptr sends generated code.  */
+    s->code_gen_epilogue = NULL;
+
     /* Generate the prologue.  */
     tcg_target_qemu_prologue(s);
     buf1 = s->code_ptr;
@@ -420,6 +477,11 @@ void tcg_prologue_init(TCGContext *s)
         qemu_log_unlock();
     }
 #endif
+
+    /* Assert that goto_ptr is implemented completely.  */
+    if (TCG_TARGET_HAS_goto_ptr) {
+        tcg_debug_assert(s->code_gen_epilogue != NULL);
+    }
 }
 
 void tcg_func_start(TCGContext *s)
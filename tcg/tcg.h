@@ -79,6 +79,14 @@ typedef uint64_t tcg_target_ulong;
 #error unsupported
 #endif
 
+/* A guest word that does not fit a host register cannot be updated
+ * atomically, which rules out multi-threaded TCG.  */
+#if TARGET_LONG_BITS > TCG_TARGET_REG_BITS
+#define TCG_OVERSIZED_GUEST 1
+#else
+#define TCG_OVERSIZED_GUEST 0
+#endif
+
 #if TCG_TARGET_NB_REGS <= 32
 typedef uint32_t TCGRegSet;
 #elif TCG_TARGET_NB_REGS <= 64
@@ -131,6 +139,13 @@ typedef uint64_t TCGRegSet;
 #define TCG_TARGET_deposit_i64_valid(ofs, len) 1
 #endif
 
+/* Backends that record every position-dependent reference they emit
+   through tcg_cache_reloc() can have their code saved and reloaded by
+   the persistent TB cache.  */
+#ifndef TCG_TARGET_TB_CACHE
+#define TCG_TARGET_TB_CACHE 0
+#endif
+
 /* Only one of DIV or DIV2 should be defined.  */
 #if defined(TCG_TARGET_HAS_div_i32)
 #define TCG_TARGET_HAS_div2_i32         0
@@ -637,6 +652,30 @@ QEMU_BUILD_BUG_ON(OPPARAM_BUF_SIZE > (1 << 14));
 /* Make sure that we don't overflow 64 bits without noticing.  */
 QEMU_BUILD_BUG_ON(sizeof(TCGOp) > 8);
 
+/* References from a TB to code outside of it, as recorded for the
+   persistent TB cache.  They are applied again when the TB is loaded at
+   a different address, possibly by a different process.  */
+typedef enum TCGCacheRelocBase {
+    TCG_CACHE_BASE_TEXT,        /* a host function, relative to tcg_gen_code */
+    TCG_CACHE_BASE_PROLOGUE,    /* code_gen_prologue */
+    TCG_CACHE_BASE_TB,          /* the TranslationBlock itself */
+} TCGCacheRelocBase;
+
+typedef enum TCGCacheRelocType {
+    TCG_CACHE_RELOC_PC32,       /* 32-bit displacement from the field end */
+    TCG_CACHE_RELOC_ABS64,      /* 64-bit absolute address */
+} TCGCacheRelocType;
+
+typedef struct TCGCacheReloc {
+    uint16_t offset;            /* of the field, from tb->tc_ptr */
+    uint8_t type;
+    uint8_t base;
+    int32_t pad;
+    int64_t addend;
+} TCGCacheReloc;
+
+#define TCG_MAX_CACHE_RELOCS 256
+
 struct TCGContext {
     uint8_t *pool_cur, *pool_end;
     TCGPool *pool_first, *pool_current, *pool_first_large;
@@ -695,6 +734,7 @@ struct TCGContext {
        extension that allows arithmetic on void*.  */
     int code_gen_max_blocks;
     void *code_gen_prologue;
+    void *code_gen_epilogue;
     void *code_gen_buffer;
     size_t code_gen_buffer_size;
     void *code_gen_ptr;
@@ -704,6 +744,12 @@ struct TCGContext {
 
     TBContext tb_ctx;
 
+    /* Persistent TB cache: the TB whose relocations are being recorded,
+       or NULL.  nb_cache_relocs is -1 if it cannot be cached.  */
+    TranslationBlock *cache_tb;
+    int nb_cache_relocs;
+    TCGCacheReloc cache_relocs[TCG_MAX_CACHE_RELOCS];
+
     /* Track which vCPU triggers events */
     CPUState *cpu;                      /* *_trans */
     TCGv_env tcg_env;                   /* *_exec  */
@@ -777,6 +823,7 @@ void tcg_prologue_init(TCGContext *s);
 void tcg_func_start(TCGContext *s);
 
 int tcg_gen_code(TCGContext *s, TranslationBlock *tb);
+uint32_t tcg_cache_host_signature(void);
 
 void tcg_set_frame(TCGContext *s, TCGReg reg, intptr_t start, intptr_t size);
 
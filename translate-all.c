@@ -52,6 +52,7 @@
 
 #include "exec/cputlb.h"
 #include "exec/tb-hash.h"
+#include "exec/tb-cache.h"
 #include "translate-all.h"
 #include "qemu/bitmap.h"
 #include "qemu/timer.h"
@@ -143,11 +144,10 @@ static void *l1_map[V_L1_MAX_SIZE];
 /* code generation context */
 TCGContext tcg_ctx;
 bool parallel_cpus;
+bool mttcg_enabled;
 
 /* translation block context */
-#ifdef CONFIG_USER_ONLY
 __thread int have_tb_lock;
-#endif
 
 static void page_table_config_init(void)
 {
@@ -169,32 +169,30 @@ static void page_table_config_init(void)
     assert(v_l2_levels >= 0);
 }
 
+/* tb_lock serializes code generation and changes to the TB lists.  Only
+ * threads that translate or patch code take it; lookups go through the
+ * qht and tb_jmp_cache, so executing vCPUs never wait for it.
+ */
 void tb_lock(void)
 {
-#ifdef CONFIG_USER_ONLY
     assert(!have_tb_lock);
     qemu_mutex_lock(&tcg_ctx.tb_ctx.tb_lock);
     have_tb_lock++;
-#endif
 }
 
 void tb_unlock(void)
 {
-#ifdef CONFIG_USER_ONLY
     assert(have_tb_lock);
     have_tb_lock--;
     qemu_mutex_unlock(&tcg_ctx.tb_ctx.tb_lock);
-#endif
 }
 
 void tb_lock_reset(void)
 {
-#ifdef CONFIG_USER_ONLY
     if (have_tb_lock) {
         qemu_mutex_unlock(&tcg_ctx.tb_ctx.tb_lock);
         have_tb_lock = 0;
     }
-#endif
 }
 
 #ifdef DEBUG_LOCKING
@@ -203,15 +201,11 @@ void tb_lock_reset(void)
 #define DEBUG_TB_LOCKS 0
 #endif
 
-#ifdef CONFIG_SOFTMMU
-#define assert_tb_lock() do { /* nothing */ } while (0)
-#else
 #define assert_tb_lock() do {               \
         if (DEBUG_TB_LOCKS) {               \
             g_assert(have_tb_lock);         \
         }                                   \
     } while (0)
-#endif
 
 
 static TranslationBlock *tb_find_pc(uintptr_t tc_ptr);
@@ -829,47 +823,110 @@ void tcg_exec_init(unsigned long tb_size)
     /* There's no guest base to take into account, so go ahead and
        initialize the prologue now.  */
     tcg_prologue_init(&tcg_ctx);
+    tcg_region_init();
 #endif
 }
 
+/* Start generating code at the beginning of region 'n'.  */
+static void tb_region_set(int n)
+{
+    TBRegion *r = &tcg_ctx.tb_ctx.regions[n];
+
+    r->ptr = r->buf;
+    r->nb_tbs = 0;
+    tcg_ctx.tb_ctx.region = n;
+    tcg_ctx.code_gen_ptr = r->buf;
+    /* Same margin as the one tcg_prologue_init() leaves at the end of
+       the whole buffer.  */
+    tcg_ctx.code_gen_highwater = r->end - 1024;
+}
+
+static void tb_region_reset(void)
+{
+    int i;
+
+    for (i = 0; i < CODE_GEN_REGIONS; i++) {
+        tcg_ctx.tb_ctx.regions[i].ptr = tcg_ctx.tb_ctx.regions[i].buf;
+        tcg_ctx.tb_ctx.regions[i].nb_tbs = 0;
+    }
+    tcg_ctx.tb_ctx.nb_tbs = 0;
+    tb_region_set(0);
+}
+
+/* Split the code buffer and the TB array into CODE_GEN_REGIONS regions.
+   Must be called after tcg_prologue_init(), which takes the prologue out
+   of the buffer.  */
+void tcg_region_init(void)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    size_t size = tcg_ctx.code_gen_buffer_size / CODE_GEN_REGIONS;
+    int max_tbs = tcg_ctx.code_gen_max_blocks / CODE_GEN_REGIONS;
+    int i;
+
+    size &= -(size_t)CODE_GEN_ALIGN;
+    for (i = 0; i < CODE_GEN_REGIONS; i++) {
+        TBRegion *r = &ctx->regions[i];
+
+        r->buf = tcg_ctx.code_gen_buffer + i * size;
+        r->end = r->buf + size;
+        r->tbs = ctx->tbs + i * max_tbs;
+        r->max_tbs = max_tbs;
+    }
+    /* The last region gets whatever did not divide evenly.  */
+    ctx->regions[CODE_GEN_REGIONS - 1].end =
+        tcg_ctx.code_gen_buffer + tcg_ctx.code_gen_buffer_size;
+    ctx->regions[CODE_GEN_REGIONS - 1].max_tbs =
+        tcg_ctx.code_gen_max_blocks - (CODE_GEN_REGIONS - 1) * max_tbs;
+
+    tb_region_reset();
+}
+
 bool tcg_enabled(void)
 {
     return tcg_ctx.code_gen_buffer != NULL;
 }
 
 /*
- * Allocate a new translation block. Flush the translation buffer if
- * too many translation blocks or too much generated code.
+ * Allocate a new translation block in the current region.  Returns NULL
+ * if the region has no TB left; the caller then evicts the oldest region.
  *
  * Called with tb_lock held.
  */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
+    TBRegion *r = &tcg_ctx.tb_ctx.regions[tcg_ctx.tb_ctx.region];
     TranslationBlock *tb;
 
     assert_tb_lock();
 
-    if (tcg_ctx.tb_ctx.nb_tbs >= tcg_ctx.code_gen_max_blocks) {
+    if (r->nb_tbs >= r->max_tbs) {
         return NULL;
     }
-    tb = &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs++];
+    tb = &r->tbs[r->nb_tbs++];
+    tcg_ctx.tb_ctx.nb_tbs++;
     tb->pc = pc;
     tb->cflags = 0;
     tb->invalid = false;
+    tb->touched = 0;
+    /* Set by tb_link_page().  A TB whose translation is abandoned before
+       then is not on any list, and eviction must leave it alone.  */
+    tb->page_addr[0] = -1;
     return tb;
 }
 
 /* Called with tb_lock held.  */
 void tb_free(TranslationBlock *tb)
 {
+    TBRegion *r = &tcg_ctx.tb_ctx.regions[tcg_ctx.tb_ctx.region];
+
     assert_tb_lock();
 
     /* In practice this is mostly used for single use temporary TB
        Ignore the hard cases and just back up if this TB happens to
        be the last one generated.  */
-    if (tcg_ctx.tb_ctx.nb_tbs > 0 &&
-            tb == &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs - 1]) {
+    if (r->nb_tbs > 0 && tb == &r->tbs[r->nb_tbs - 1]) {
         tcg_ctx.code_gen_ptr = tb->tc_ptr;
+        r->nb_tbs--;
         tcg_ctx.tb_ctx.nb_tbs--;
     }
 }
@@ -948,11 +1005,10 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
         }
     }
 
-    tcg_ctx.tb_ctx.nb_tbs = 0;
     qht_reset_size(&tcg_ctx.tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     page_flush_tb();
 
-    tcg_ctx.code_gen_ptr = tcg_ctx.code_gen_buffer;
+    tb_region_reset();
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     atomic_mb_set(&tcg_ctx.tb_ctx.tb_flush_count,
@@ -1093,11 +1149,12 @@ static inline void tb_jmp_unlink(TranslationBlock *tb)
     }
 }
 
-/* invalidate one TB
+/* invalidate one TB, without counting it as an invalidation
  *
  * Called with tb_lock held.
  */
-void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
+static void tb_phys_invalidate_1(TranslationBlock *tb,
+                                 tb_page_addr_t page_addr)
 {
     CPUState *cpu;
     PageDesc *p;
@@ -1139,10 +1196,117 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 
     /* suppress any remaining jumps to this TB */
     tb_jmp_unlink(tb);
+}
 
+/* invalidate one TB
+ *
+ * Called with tb_lock held.
+ */
+void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
+{
+    tb_phys_invalidate_1(tb, page_addr);
     tcg_ctx.tb_ctx.tb_phys_invalidate_count++;
 }
 
+typedef struct TBEvictRequest {
+    unsigned tb_flush_count;
+    unsigned tb_evict_count;
+} TBEvictRequest;
+
+/* Return true if more than a quarter of the TBs in the region were looked
+   up since the region was last considered for eviction, and start over
+   counting.  Chained TBs run without a lookup, so this only catches the
+   blocks that are entered from the main loop or through lookup_tb_ptr,
+   which in practice are the heads of the hot loops and functions.  */
+static bool tb_region_test_and_clear_hot(TBRegion *r)
+{
+    int i, touched = 0;
+
+    for (i = 0; i < r->nb_tbs; i++) {
+        if (r->tbs[i].touched) {
+            r->tbs[i].touched = 0;
+            touched++;
+        }
+    }
+    return touched * 4 > r->nb_tbs;
+}
+
+/* Evict a region and continue generating code there.  The regions are
+   considered round-robin starting after the current one, and a hot region
+   is skipped until the next round.  If all of them are hot, the one after
+   the current region goes.  */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data data)
+{
+    TBEvictRequest *req = data.host_ptr;
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r;
+    int i, n;
+
+    tb_lock();
+
+    /* If it is already been done on request of another CPU, or the
+     * buffer has been flushed meanwhile, just retry.
+     */
+    if (ctx->tb_evict_count != req->tb_evict_count ||
+        ctx->tb_flush_count != req->tb_flush_count) {
+        goto done;
+    }
+
+    ctx->regions[ctx->region].ptr = tcg_ctx.code_gen_ptr;
+    n = (ctx->region + 1) % CODE_GEN_REGIONS;
+    for (i = 1; i < CODE_GEN_REGIONS; i++) {
+        int c = (ctx->region + i) % CODE_GEN_REGIONS;
+
+        if (!tb_region_test_and_clear_hot(&ctx->regions[c])) {
+            n = c;
+            break;
+        }
+    }
+    r = &ctx->regions[n];
+
+    /* Unlinking the TBs also resets the jumps into them from the TBs
+       that are kept.  */
+    for (i = 0; i < r->nb_tbs; i++) {
+        TranslationBlock *tb = &r->tbs[i];
+
+        if (!tb->invalid && tb->page_addr[0] != -1) {
+            tb_phys_invalidate_1(tb, -1);
+            ctx->tb_evicted_tbs++;
+        }
+    }
+
+    /* The TBs are about to be reused, so no tb_jmp_cache may point at
+       them any more, not even at those invalidated earlier.  */
+    CPU_FOREACH(cpu) {
+        for (i = 0; i < TB_JMP_CACHE_SIZE; ++i) {
+            TranslationBlock *tb = atomic_read(&cpu->tb_jmp_cache[i]);
+
+            if (tb >= r->tbs && tb < r->tbs + r->max_tbs) {
+                atomic_set(&cpu->tb_jmp_cache[i], NULL);
+            }
+        }
+    }
+
+    ctx->nb_tbs -= r->nb_tbs;
+    tb_region_set(n);
+    atomic_mb_set(&ctx->tb_evict_count, ctx->tb_evict_count + 1);
+
+done:
+    tb_unlock();
+    g_free(req);
+}
+
+/* Make room in a full code buffer.  Unlike tb_flush(), this keeps all the
+   TBs but those of one region.  */
+static void tb_evict(CPUState *cpu)
+{
+    TBEvictRequest *req = g_new(TBEvictRequest, 1);
+
+    req->tb_flush_count = atomic_mb_read(&tcg_ctx.tb_ctx.tb_flush_count);
+    req->tb_evict_count = atomic_mb_read(&tcg_ctx.tb_ctx.tb_evict_count);
+    async_safe_run_on_cpu(cpu, do_tb_evict, RUN_ON_CPU_HOST_PTR(req));
+}
+
 #ifdef CONFIG_SOFTMMU
 static void build_page_bitmap(PageDesc *p)
 {
@@ -1287,8 +1451,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
  buffer_overflow:
-        /* flush must be done */
-        tb_flush(cpu);
+        tcg_ctx.cache_tb = NULL;
+        /* the oldest region must be evicted */
+        tb_evict(cpu);
         mmap_unlock();
         cpu_loop_exit(cpu);
     }
@@ -1299,6 +1464,11 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
 
+    /* A TB from the persistent cache is copied, not translated.  */
+    if (tb_cache_load(cpu, tb, phys_pc, &gen_code_size, &search_size)) {
+        goto code_done;
+    }
+
 #ifdef CONFIG_PROFILER
     tcg_ctx.tb_count1++; /* includes aborted translations because of
                        exceptions */
@@ -1334,8 +1504,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     /* ??? Overflow could be handled better here.  In particular, we
        don't need to re-do gen_intermediate_code, nor should we re-do
        the tcg optimization currently hidden inside tcg_gen_code.  All
-       that should be required is to flush the TBs, allocate a new TB,
+       that should be required is to evict a region, allocate a new TB,
        re-initialize it per above, and re-do the actual code generation.  */
+    tcg_ctx.cache_tb = tb_cache_enabled(cpu, cflags) ? tb : NULL;
+    tcg_ctx.nb_cache_relocs = 0;
     gen_code_size = tcg_gen_code(&tcg_ctx, tb);
     if (unlikely(gen_code_size < 0)) {
         goto buffer_overflow;
@@ -1364,6 +1536,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
 #endif
 
+    if (tcg_ctx.cache_tb) {
+        tb_cache_record(tb, phys_pc, gen_code_size, search_size);
+        tcg_ctx.cache_tb = NULL;
+    }
+
+ code_done:
     tcg_ctx.code_gen_ptr = (void *)
         ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
                  CODE_GEN_ALIGN);
@@ -1388,10 +1566,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if ((pc & TARGET_PAGE_MASK) != virt_page2) {
         phys_page2 = get_page_addr_code(env, virt_page2);
     }
-    /* As long as consistency of the TB stuff is provided by tb_lock in user
-     * mode and is implicit in single-threaded softmmu emulation, no explicit
-     * memory barrier is required before tb_link_page() makes the TB visible
-     * through the physical hash table and physical page list.
+    /* As long as consistency of the TB stuff is provided by tb_lock, no
+     * explicit memory barrier is required before tb_link_page() makes the
+     * TB visible through the physical hash table and physical page list.
      */
     tb_link_page(tb, phys_pc, phys_page2);
     return tb;
@@ -1666,23 +1843,31 @@ static bool tb_invalidate_phys_page(tb_page_addr_t addr, uintptr_t pc)
    tb[1].tc_ptr. Return NULL if not found */
 static TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
 {
-    int m_min, m_max, m;
-    uintptr_t v;
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    int m_min, m_max, m, n;
+    uintptr_t v, region_size;
     TranslationBlock *tb;
+    TBRegion *r;
+    void *end;
 
-    if (tcg_ctx.tb_ctx.nb_tbs <= 0) {
+    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer) {
         return NULL;
     }
-    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer ||
-        tc_ptr >= (uintptr_t)tcg_ctx.code_gen_ptr) {
+    /* all regions but the last one have the same size */
+    region_size = ctx->regions[0].end - ctx->regions[0].buf;
+    n = MIN((tc_ptr - (uintptr_t)tcg_ctx.code_gen_buffer) / region_size,
+            CODE_GEN_REGIONS - 1);
+    r = &ctx->regions[n];
+    end = n == ctx->region ? tcg_ctx.code_gen_ptr : r->ptr;
+    if (r->nb_tbs <= 0 || tc_ptr >= (uintptr_t)end) {
         return NULL;
     }
     /* binary search (cf Knuth) */
     m_min = 0;
-    m_max = tcg_ctx.tb_ctx.nb_tbs - 1;
+    m_max = r->nb_tbs - 1;
     while (m_min <= m_max) {
         m = (m_min + m_max) >> 1;
-        tb = &tcg_ctx.tb_ctx.tbs[m];
+        tb = &r->tbs[m];
         v = (uintptr_t)tb->tc_ptr;
         if (v == tc_ptr) {
             return tb;
@@ -1692,7 +1877,7 @@ static TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
             m_min = m + 1;
         }
     }
-    return &tcg_ctx.tb_ctx.tbs[m_max];
+    return &r->tbs[m_max];
 }
 
 #if !defined(CONFIG_USER_ONLY)
@@ -1874,9 +2059,11 @@ static void print_qht_statistics(FILE *f, fprintf_function cpu_fprintf,
 
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
-    int i, target_code_size, max_target_code_size;
+    int i, n, target_code_size, max_target_code_size;
     int direct_jmp_count, direct_jmp2_count, cross_page;
+    ptrdiff_t code_size;
     TranslationBlock *tb;
+    TBRegion *r;
     struct qht_stats hst;
 
     tb_lock();
@@ -1886,27 +2073,34 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cross_page = 0;
     direct_jmp_count = 0;
     direct_jmp2_count = 0;
-    for (i = 0; i < tcg_ctx.tb_ctx.nb_tbs; i++) {
-        tb = &tcg_ctx.tb_ctx.tbs[i];
-        target_code_size += tb->size;
-        if (tb->size > max_target_code_size) {
-            max_target_code_size = tb->size;
-        }
-        if (tb->page_addr[1] != -1) {
-            cross_page++;
-        }
-        if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
-            direct_jmp_count++;
-            if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
-                direct_jmp2_count++;
+    code_size = 0;
+    for (n = 0; n < CODE_GEN_REGIONS; n++) {
+        r = &tcg_ctx.tb_ctx.regions[n];
+        code_size += (n == tcg_ctx.tb_ctx.region ? tcg_ctx.code_gen_ptr
+                                                  : r->ptr) - r->buf;
+        for (i = 0; i < r->nb_tbs; i++) {
+            tb = &r->tbs[i];
+            target_code_size += tb->size;
+            if (tb->size > max_target_code_size) {
+                max_target_code_size = tb->size;
+            }
+            if (tb->page_addr[1] != -1) {
+                cross_page++;
+            }
+            if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
+                direct_jmp_count++;
+                if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
+                    direct_jmp2_count++;
+                }
             }
         }
     }
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
     cpu_fprintf(f, "gen code size       %td/%zd\n",
-                tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer,
-                tcg_ctx.code_gen_highwater - tcg_ctx.code_gen_buffer);
+                code_size, tcg_ctx.code_gen_buffer_size);
+    cpu_fprintf(f, "code regions        %d (current %d)\n",
+                CODE_GEN_REGIONS, tcg_ctx.tb_ctx.region);
     cpu_fprintf(f, "TB count            %d/%d\n",
             tcg_ctx.tb_ctx.nb_tbs, tcg_ctx.code_gen_max_blocks);
     cpu_fprintf(f, "TB avg target size  %d max=%d bytes\n",
@@ -1914,12 +2108,8 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
                     tcg_ctx.tb_ctx.nb_tbs : 0,
             max_target_code_size);
     cpu_fprintf(f, "TB avg host size    %td bytes (expansion ratio: %0.1f)\n",
-            tcg_ctx.tb_ctx.nb_tbs ? (tcg_ctx.code_gen_ptr -
-                                     tcg_ctx.code_gen_buffer) /
-                                     tcg_ctx.tb_ctx.nb_tbs : 0,
-                target_code_size ? (double) (tcg_ctx.code_gen_ptr -
-                                             tcg_ctx.code_gen_buffer) /
-                                             target_code_size : 0);
+            tcg_ctx.tb_ctx.nb_tbs ? code_size / tcg_ctx.tb_ctx.nb_tbs : 0,
+                target_code_size ? (double) code_size / target_code_size : 0);
     cpu_fprintf(f, "cross page TB count %d (%d%%)\n", cross_page,
             tcg_ctx.tb_ctx.nb_tbs ? (cross_page * 100) /
                                     tcg_ctx.tb_ctx.nb_tbs : 0);
@@ -1938,9 +2128,13 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %u\n",
             atomic_read(&tcg_ctx.tb_ctx.tb_flush_count));
+    cpu_fprintf(f, "TB evict count      %u (%u TBs)\n",
+            atomic_read(&tcg_ctx.tb_ctx.tb_evict_count),
+            tcg_ctx.tb_ctx.tb_evicted_tbs);
     cpu_fprintf(f, "TB invalidate count %d\n",
             tcg_ctx.tb_ctx.tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
+    tb_cache_dump_info(f, cpu_fprintf);
     tcg_dump_info(f, cpu_fprintf);
 
     tb_unlock();
@@ -72,6 +72,14 @@ uint8_t fifo8_pop(Fifo8 *fifo)
     return ret;
 }
 
+uint8_t fifo8_peek(Fifo8 *fifo)
+{
+    if (fifo->num == 0) {
+        abort();
+    }
+    return fifo->data[fifo->head];
+}
+
 const uint8_t *fifo8_pop_buf(Fifo8 *fifo, uint32_t max, uint32_t *num)
 {
     uint8_t *ret;